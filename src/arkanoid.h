@@ -1,102 +1,16 @@
 #ifndef ARKANOID_H
 #define ARKANOID_H
 
-#include <stdint.h>
-#include <assert.h>
-#include <malloc.h>
+#include "game.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <pthread.h>
 
-typedef int8_t i8;
-typedef int16_t i16;
-typedef int32_t i32;
-typedef int64_t i64;
-typedef uint8_t u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-typedef float f32;
-typedef double f64;
-
-#include "math.h"
-#include "random.h"
+#include "frame_stats.h"
 #include "shader.h"
-#include "levels.h"
+#include "stream_buffer.h"
 #include "shaders.h"
-#include "colors.h"
-
-#define min(a, b) ((a) < (b) ? (a) : (b))
-#define max(a, b) ((a) < (b) ? (b) : (a))
-#define swap(a, b) { auto &aa = (a), &bb = (b); auto tmp = aa; aa = bb; bb = tmp; }
-
-#define PI32 3.14159265359f
-
-template<typename Lambda>
-struct Scope_guard
-{
-   Scope_guard(Lambda lambda) : lambda(lambda) {}
-   ~Scope_guard() { lambda(); }
-
-   Lambda lambda;
-};
-
-#define DO_CONCAT(a, b) a##b
-#define CONCAT(a, b) DO_CONCAT(a, b)
-#define UNIQUENAME( prefix ) CONCAT(prefix, __COUNTER__)
-#define defer Scope_guard UNIQUENAME(sg) = [&]()
-
-template<typename T>
-struct Array
-{
-   T *data;
-   i32 length;
-   i32 capacity;
-
-   T* begin() { return data; }
-   T* end() { return data + length; }
-   T& operator[](i32 index) { return data[index]; }
-};
-
-template<typename T>
-Array<T>
-array_create(i32 length = 0)
-{
-   Array<T> arr;
-   arr.length = length;
-   arr.capacity = length;
-
-   if (length)
-      arr.data = (T *)malloc(length * sizeof(T));
-   else
-      arr.data = 0;
-
-   return arr;
-}
-
-template<typename T>
-void
-array_add(Array<T> *arr, T elem)
-{
-   assert(arr->length <= arr->capacity);
-
-   if (arr->length == arr->capacity)
-   {
-      if (arr->capacity == 0) arr->capacity = 1;
-      else arr->capacity *= 2;
-      arr->data = (T *)realloc(arr->data, arr->capacity * sizeof(T));
-   }
-
-   arr->data[arr->length++] = elem;
-}
-
-template<typename T>
-void
-array_free(Array<T> arr)
-{
-   if (arr.data)
-      free(arr.data);
-}
 
 #ifndef ARKANOID_SLOW
 #define GL_CALL(x) while (glGetError() != GL_NO_ERROR); x; assert(gl_log_error(#x, __FILE__, __LINE__))
@@ -104,145 +18,133 @@ array_free(Array<T> arr)
 #define GL_CALL(x) x
 #endif
 
-enum Collectable_type
-{
-   COLLECTABLE_TYPE_NONE = 0,
-   COLLECTABLE_TYPE_LONG_PADDLE,
-   COLLECTABLE_TYPE_SHORT_PADDLE,
-   COLLECTABLE_TYPE_FAST_BALL,
-   COLLECTABLE_TYPE_SLOW_BALL,
-   COLLECTABLE_TYPE_BALL_SPLIT,
-};
+// More cells changed since the last frame than this re-upload all the alive
+// bits at once. Must not exceed BLOCK_CHANGE_LOG_SIZE.
+#define MAX_ALIVE_WORD_UPLOADS 64
 
-struct Level
-{
-   void *allocated_memory;
+// GPU timer queries of a frame are read back GPU_TIMER_FRAMES frames later,
+// when the GPU is done with them, so that reading never stalls.
+#define GPU_TIMER_FRAMES 2
 
-   i32 num_rows;
-   i32 num_cols;
+// Side of the background pattern's tile in pixels, as in
+// background_tile_fragment_code.
+#define BACKGROUND_TILE_SIZE 50
 
-   i32 num_blocks;
-   v2 *translations;
-   v3 *colors;
-   Collectable_type *collectable_types;
-
-   f32 block_half_width;
-   f32 block_half_height;
-
-   GLuint vao;
-   GLuint vbo;
-   GLsizeiptr vbo_allocated_size;
-};
-
-struct All_levels_data
-{
-   Level *levels;
-   i32 num_levels;
-};
-
-struct Background
+enum Sprite_shape
 {
-   GLuint vao;
+   SPRITE_SHAPE_RECT = 0,
+   SPRITE_SHAPE_DISC,
 };
 
-struct Paddle
+// Instance of the sprite shader, two RGBA texels of a buffer texture: where
+// its center is and its half size, then its color and Sprite_shape. Blocks of
+// the level are all rectangles, they keep their cell there instead.
+struct Sprite
 {
    v2 translate;
-   f32 speed;
-
-   static constexpr f32 NORMAL_BODY_WIDTH = 0.2f;
-   static constexpr f32 SHORT_BODY_WIDTH = 0.1f;
-   static constexpr f32 LONG_BODY_WIDTH = 0.4f;
+   v2 half_size;
+   v3 color;
+   union
+   {
+      f32 shape;
+      i32 cell;
+   };
+};
 
-   f32 body_half_width;
-   f32 body_half_height;
+static_assert(sizeof(Sprite) == 8 * sizeof(f32), "Sprite must be two RGBA32 texels.");
 
-   static constexpr i32 NUM_SEGMENTS = 6;
-   f32 segment_length;
-   f32 segment_bounce_angles[NUM_SEGMENTS];
+// Blocks of the current level on the GPU. The sprites buffer holds all of
+// them, uploaded once when the level is entered, and the alive bits of the
+// level's cells, a buffer texture that the shader culls destroyed blocks with.
+// A hit only uploads the word holding its bit. Both are reused by every level
+// and only grow, when a level bigger than all the previous ones comes.
+struct Level_graphics
+{
+   GLuint sprites_buffer;
+   GLuint sprites_texture;
+   GLsizeiptr sprites_allocated_size;
 
-   GLuint vao;
+   GLuint alive_cells_buffer;
+   GLuint alive_cells_texture;
+   GLsizeiptr alive_cells_allocated_size;
 };
 
-struct Ball
+// Everything that is needed to draw a Game_state. The simulation never
+// touches it, it only reads the state after the update.
+struct Renderer
 {
-   static constexpr f32 NORMAL_SPEED = 1.6f;
-   static constexpr f32 FAST_SPEED = 1.8f;
-   static constexpr f32 SLOW_SPEED = 1.3f;
+   Graphics::Program_cache program_cache;
 
-   v2 translate;
-   f32 speed;
-   v2 velocity;
+   GLuint bg_shader;
+   GLuint sprite_shader;
 
-   f32 radius;
-   f32 half_radius;
+   GLint bg_shader_pulse_uniform;
+   GLint sprite_shader_num_level_sprites_uniform;
+   GLint sprite_shader_frame_sprites_base_uniform;
 
-   GLuint vao;
-};
+   // GL_MAX_TEXTURE_BUFFER_SIZE, levels that need more are refused.
+   GLint max_texture_buffer_texels;
 
-struct Collectables
-{
-   static const i32 MAX_NUM_COLLECTABLES = 50;
-   i32 num_collectables;
+   // The one unit square every draw call is made of.
+   GLuint quad_vao;
 
-   Collectable_type types[MAX_NUM_COLLECTABLES];
-   v2 translations[MAX_NUM_COLLECTABLES];
-   v3 colors[MAX_NUM_COLLECTABLES];
+   // The background's pattern never changes, one tile of it is rendered at
+   // init and repeated over the window, only the pulse is shaded per frame.
+   GLuint bg_tile_texture;
 
-   f32 fall_speed;
+   // Paddle, collectables and balls, interpolated into sprites every frame.
+   Graphics::Stream_buffer stream;
+   GLuint frame_sprites_texture;
+   i32 frame_sprites_base;
+   i32 num_frame_sprites;
 
-   f32 body_half_width;
-   f32 body_half_height;
+   Level_graphics blocks;
 
-   GLuint vao;
-   GLuint vbo;
-};
+   i32 uploaded_level_index;
+   u32 uploaded_blocks_version;
+   // Bytes sent to the GPU by the last upload_frame.
+   i64 upload_bytes;
 
-enum Wait_event
-{
-   WAIT_EVENT_NONE = 0,
-   WAIT_EVENT_NEXT_LEVEL,
-   WAIT_EVENT_GAME_OVER,
+   GLuint gpu_timer_queries[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+   bool gpu_timers_issued[GPU_TIMER_FRAMES];
+   i32 gpu_timer_frame;
 };
 
-struct Game_state
+// Thread that loads the next level during the pause before it, so that the
+// transition only swaps it in. See claim_level_prefetch.
+struct Level_loader
 {
-   All_levels_data all_levels_data;
-   Paddle          paddle;
-   Ball            ball;
-   Collectables    collectables;
-
-   bool paused;
+   pthread_t thread;
    bool started;
 
+   All_levels_data *all_levels_data;
    i32 level_index;
-   Level *level;
-   i32 num_blocks_left;
-
-   Wait_event wait_event;
-   f32 wait_time_left;
-
-   static const i32 INITIAL_LIVES = 3;
-   i32 lives_left;
 };
 
 bool
 gl_log_error(const char *call, const char *file, int line);
 
 void
-change_level(Game_state *game_state, i32 new_level_index);
+start_level_loader(Level_loader *loader, All_levels_data *all_levels_data, i32 level_index);
 void
-restart_level_maintaining_destroyed_blocks(Game_state *game_state);
+join_level_loader(Level_loader *loader);
 
+// Shader programs are loaded from and saved to shader_cache_directory, 0
+// compiles them all.
+bool
+renderer_init(Renderer *renderer, Game_state *game_state, const char *shader_cache_directory);
+// A frame is drawn in two passes, so that they can be timed separately.
+// upload_frame interpolates positions and updates the buffers, draw_frame
+// submits the draw calls. upload_frame fails on a level too large to draw.
+bool
+upload_frame(Renderer *renderer, Game_state *game_state, f32 alpha);
 void
-ball_follow_paddle(Ball *ball, Paddle *paddle);
-
-void
-add_collectable(Collectables *collectables, i32 index);
-void
-remove_collectable(Collectables *collectables, i32 index);
+draw_frame(Renderer *renderer, Game_state *game_state, f32 bg_time);
 
-void
-set_paddle_width(Paddle *paddle, f32 new_width);
+// Reads the GPU time of every draw pass of the oldest frame in flight. Call
+// before draw_frame, which reuses its queries. Returns false when there is
+// nothing to read or the GPU is not done yet, that frame is skipped then.
+bool
+read_gpu_pass_times(Renderer *renderer, f32 pass_ms[GPU_PASS_COUNT]);
 
 #endif
@@ -0,0 +1,94 @@
+#ifndef BASE_H
+#define BASE_H
+
+#include <stdint.h>
+#include <assert.h>
+#include <malloc.h>
+
+typedef int8_t i8;
+typedef int16_t i16;
+typedef int32_t i32;
+typedef int64_t i64;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef float f32;
+typedef double f64;
+
+#include "math.h"
+#include "random.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) < (b) ? (b) : (a))
+#define swap(a, b) { auto &aa = (a), &bb = (b); auto tmp = aa; aa = bb; bb = tmp; }
+
+#define PI32 3.14159265359f
+
+template<typename Lambda>
+struct Scope_guard
+{
+   Scope_guard(Lambda lambda) : lambda(lambda) {}
+   ~Scope_guard() { lambda(); }
+
+   Lambda lambda;
+};
+
+#define DO_CONCAT(a, b) a##b
+#define CONCAT(a, b) DO_CONCAT(a, b)
+#define UNIQUENAME( prefix ) CONCAT(prefix, __COUNTER__)
+#define defer Scope_guard UNIQUENAME(sg) = [&]()
+
+template<typename T>
+struct Array
+{
+   T *data;
+   i32 length;
+   i32 capacity;
+
+   T* begin() { return data; }
+   T* end() { return data + length; }
+   T& operator[](i32 index) { return data[index]; }
+};
+
+template<typename T>
+Array<T>
+array_create(i32 length = 0)
+{
+   Array<T> arr;
+   arr.length = length;
+   arr.capacity = length;
+
+   if (length)
+      arr.data = (T *)malloc(length * sizeof(T));
+   else
+      arr.data = 0;
+
+   return arr;
+}
+
+template<typename T>
+void
+array_add(Array<T> *arr, T elem)
+{
+   assert(arr->length <= arr->capacity);
+
+   if (arr->length == arr->capacity)
+   {
+      if (arr->capacity == 0) arr->capacity = 1;
+      else arr->capacity *= 2;
+      arr->data = (T *)realloc(arr->data, arr->capacity * sizeof(T));
+   }
+
+   arr->data[arr->length++] = elem;
+}
+
+template<typename T>
+void
+array_free(Array<T> arr)
+{
+   if (arr.data)
+      free(arr.data);
+}
+
+#endif
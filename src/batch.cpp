@@ -0,0 +1,275 @@
+#include "game.h"
+#include "game.cpp"
+#include "bot.h"
+#include "jobs.h"
+#include "level_generator.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+// Plays many complete games at once, spread over all cores, and reports
+// aggregate simulation throughput and per-level clear statistics.
+// Usage: arkanoid_batch [num_games] [max_ticks_per_game] [num_threads] [seed] [--generate num_levels]
+//
+// Game i starts on level i % num_levels, is seeded with seed + i and plays the
+// level until it is cleared, all lives are lost or max_ticks_per_game runs
+// out. Results do not depend on the number of threads. --generate plays
+// num_levels procedurally generated levels instead of the built-in ones, made
+// from seed on all the threads before the games start, see level_generator.h.
+
+#define MAX_NUM_THREADS 1024
+
+enum Game_outcome
+{
+   GAME_OUTCOME_CLEARED = 0,
+   GAME_OUTCOME_LOST,
+   GAME_OUTCOME_TIMED_OUT,
+};
+
+struct Game_result
+{
+   i32 level_index;
+   Game_outcome outcome;
+   i64 num_ticks;
+};
+
+struct Batch
+{
+   // Built-in levels when null.
+   const Level_table *level_tables;
+   i32 num_levels;
+   i64 max_ticks_per_game;
+   u64 seed;
+   Game_result *results;
+};
+
+static f64
+get_time()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+play_game(void *data, i32 game_index, i32)
+{
+   PROFILE_ZONE("play_game");
+
+   Batch *batch = (Batch *)data;
+   Game_result *result = &batch->results[game_index];
+
+   Game_state *game_state = (Game_state *)malloc(sizeof(Game_state));
+   defer { free(game_state); };
+
+   bool initialized = batch->level_tables ?
+      game_init(game_state, batch->seed + game_index, batch->level_tables, batch->num_levels) :
+      game_init(game_state, batch->seed + game_index);
+   if (!initialized)
+      exit(EXIT_FAILURE);
+   defer { game_free(game_state); };
+
+   result->level_index = game_index % batch->num_levels;
+   result->outcome = GAME_OUTCOME_TIMED_OUT;
+   change_level(game_state, result->level_index);
+
+   // Ticks actually simulated, a game that times out ran exactly
+   // max_ticks_per_game of them.
+   i64 num_ticks = 0;
+   while (num_ticks < batch->max_ticks_per_game)
+   {
+      Input input = bot_input(game_state, (u32)num_ticks);
+      game_update(game_state, input, SIMULATION_DT);
+      ++num_ticks;
+
+      if (game_state->wait_event == WAIT_EVENT_NEXT_LEVEL)
+      {
+         result->outcome = GAME_OUTCOME_CLEARED;
+         break;
+      }
+      if (game_state->wait_event == WAIT_EVENT_GAME_OVER && game_state->lives_left == 0)
+      {
+         result->outcome = GAME_OUTCOME_LOST;
+         break;
+      }
+   }
+
+   result->num_ticks = num_ticks;
+}
+
+// Whole decimal numbers only, so that unknown flags and typos are not taken
+// for one.
+static bool
+parse_number(const char *text, u64 *value)
+{
+   if (*text < '0' || *text > '9')
+      return false;
+
+   char *end;
+   errno = 0;
+   *value = strtoull(text, &end, 10);
+   return *end == 0 && errno == 0;
+}
+
+static int
+compare_i64(const void *a, const void *b)
+{
+   i64 x = *(const i64 *)a;
+   i64 y = *(const i64 *)b;
+   return (x > y) - (x < y);
+}
+
+i32
+main(i32 argc, char **argv)
+{
+   i32 num_games = 10000;
+   i64 max_ticks_per_game = 240 * SIMULATION_TICK_RATE;
+   i32 num_threads = 0;
+   u64 seed = 1;
+
+   i32 num_generated_levels = 0;
+
+   // Game and tick counts have to be positive, 0 threads picks one per
+   // hardware thread.
+   i32 num_positional = 0;
+   u64 number;
+   for (i32 i = 1; i < argc; ++i)
+   {
+      if (strcmp(argv[i], "--generate") == 0 && i+1 < argc && parse_number(argv[i+1], &number) &&
+          number > 0 && number <= INT32_MAX)
+      {
+         num_generated_levels = (i32)number;
+         ++i;
+      }
+      else if (num_positional == 0 && parse_number(argv[i], &number) && number > 0 && number <= INT32_MAX)
+      {
+         num_games = (i32)number;
+         ++num_positional;
+      }
+      else if (num_positional == 1 && parse_number(argv[i], &number) && number > 0 && number <= INT64_MAX)
+      {
+         max_ticks_per_game = (i64)number;
+         ++num_positional;
+      }
+      else if (num_positional == 2 && parse_number(argv[i], &number) && number <= MAX_NUM_THREADS)
+      {
+         num_threads = (i32)number;
+         ++num_positional;
+      }
+      else if (num_positional == 3 && parse_number(argv[i], &number))
+      {
+         seed = number;
+         ++num_positional;
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [num_games] [max_ticks_per_game] [num_threads] [seed] [--generate num_levels]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   Batch batch;
+   batch.level_tables = 0;
+   batch.num_levels = num_levels;
+   batch.max_ticks_per_game = max_ticks_per_game;
+   batch.seed = seed;
+   batch.results = (Game_result *)malloc(num_games * sizeof(Game_result));
+   defer { free(batch.results); };
+
+   Job_pool *pool = job_pool_create(num_threads);
+   defer { job_pool_destroy(pool); };
+
+   Generated_levels generated_levels = {};
+   defer { free_generated_levels(&generated_levels); };
+
+   if (num_generated_levels > 0)
+   {
+      Level_generator generator;
+      generator.params = default_level_generator_params();
+      generator.seed = seed;
+
+      f64 generate_begin_time = get_time();
+      generate_levels(&generated_levels, &generator, num_generated_levels, pool);
+      f64 generate_elapsed = get_time() - generate_begin_time;
+
+      batch.level_tables = generated_levels.tables;
+      batch.num_levels = generated_levels.num_levels;
+
+      printf("Generated %d levels on %d threads in %.3fs (%.1fus per level).\n",
+            num_generated_levels,
+            pool->num_workers,
+            generate_elapsed,
+            generate_elapsed * 1e6 / num_generated_levels);
+   }
+
+   f64 begin_time = get_time();
+   job_pool_run(pool, num_games, play_game, &batch);
+   f64 elapsed = get_time() - begin_time;
+
+   i64 total_ticks = 0;
+   for (i32 i = 0; i < num_games; ++i)
+      total_ticks += batch.results[i].num_ticks;
+
+   profile_write_trace("arkanoid_batch_trace.json");
+
+   printf("Played %d games on %d threads in %.3fs.\n", num_games, pool->num_workers, elapsed);
+   printf("Simulated %lld ticks (%.0f ticks/s).\n", (long long)total_ticks, total_ticks / elapsed);
+   printf("\n");
+   printf("level  games  cleared  lost  timed out  clear rate  time to clear p50/p90/p99/max [s]\n");
+
+   i64 *clear_ticks = (i64 *)malloc(num_games * sizeof(i64));
+   defer { free(clear_ticks); };
+
+   for (i32 level_index = 0; level_index < batch.num_levels; ++level_index)
+   {
+      i32 num_level_games = 0;
+      i32 num_cleared = 0;
+      i32 num_lost = 0;
+      i32 num_timed_out = 0;
+
+      for (i32 i = 0; i < num_games; ++i)
+      {
+         Game_result *result = &batch.results[i];
+         if (result->level_index != level_index)
+            continue;
+
+         ++num_level_games;
+         switch (result->outcome)
+         {
+            case GAME_OUTCOME_CLEARED: {
+               clear_ticks[num_cleared++] = result->num_ticks;
+            } break;
+            case GAME_OUTCOME_LOST: ++num_lost; break;
+            case GAME_OUTCOME_TIMED_OUT: ++num_timed_out; break;
+         }
+      }
+
+      if (!num_level_games)
+         continue;
+
+      printf("%5d  %5d  %7d  %4d  %9d  %9.1f%%",
+            level_index+1,
+            num_level_games,
+            num_cleared,
+            num_lost,
+            num_timed_out,
+            100.0 * num_cleared / num_level_games);
+
+      if (num_cleared)
+      {
+         qsort(clear_ticks, num_cleared, sizeof(i64), compare_i64);
+         printf("  %.2f / %.2f / %.2f / %.2f",
+               clear_ticks[(num_cleared-1) * 50 / 100] * SIMULATION_DT,
+               clear_ticks[(num_cleared-1) * 90 / 100] * SIMULATION_DT,
+               clear_ticks[(num_cleared-1) * 99 / 100] * SIMULATION_DT,
+               clear_ticks[num_cleared-1] * SIMULATION_DT);
+      }
+
+      printf("\n");
+   }
+
+   return EXIT_SUCCESS;
+}
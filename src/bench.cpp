@@ -0,0 +1,697 @@
+#include "game.h"
+#include "game.cpp"
+#include "bot.h"
+#include "replay.cpp"
+#include "level_generator.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Benchmarks of the simulation hot paths (micro) and of whole recorded
+// sessions on every level, on synthetic huge levels and on stress levels of
+// growing block counts (macro). The stress/ ones are the tick time versus
+// block count curve.
+// Usage: arkanoid_bench [--filter text] [--json file] [--compare baseline.json] [--threshold percent]
+//
+// Every benchmark runs a number of samples, each timing a batch of operations.
+// Times are reported per operation: the mean over all samples and the
+// p50/p90/p99/max of the per-sample averages. --json writes the results, one
+// benchmark per line. --compare reads such a file back and fails if the p50 of
+// any benchmark got slower than the baseline by more than threshold percent
+// (10 by default).
+
+struct Benchmark;
+// Runs one sample and returns the seconds it took to do *num_ops operations.
+typedef f64 Bench_function(Benchmark *benchmark, i64 *num_ops);
+
+struct Benchmark
+{
+   char name[64];
+   i32 num_samples;
+   Bench_function *function;
+
+   Game_state *game_state;
+   // State every sample starts from.
+   void *snapshot;
+   // Inputs of the session played by the replay benchmarks.
+   Replay replay;
+   void *scratch;
+};
+
+struct Bench_result
+{
+   char name[64];
+   i32 num_samples;
+   f64 mean_ns;
+   f64 p50_ns;
+   f64 p90_ns;
+   f64 p99_ns;
+   f64 max_ns;
+};
+
+#define BENCH_SEED 1
+#define BENCH_NUM_BALL_STARTS 256
+
+struct Ball_start
+{
+   v2 translation;
+   v2 velocity;
+};
+
+// Split blocks up front, the balls multiply long before the wall is through.
+// None of the built-in levels has them.
+static const char *split_level_text =
+R"FOO(
+.............
+.............
+.............
+.X.X.X.X.X.X.
+XXXXXXXXXXXXX
+XSXXXXSXXXXSX
+XXXXXXXXXXXXX
+..S.......S..
+.............
+.............
+.............
+.............
+.............
+)FOO";
+
+static Ball_start ball_starts[BENCH_NUM_BALL_STARTS];
+static v2 collectable_starts[Collectables::MAX_NUM_COLLECTABLES];
+
+static f64
+get_time()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static f64
+bench_parse_levels(Benchmark *benchmark, i64 *num_ops)
+{
+   i32 num_rounds = 20;
+
+   f64 begin_time = get_time();
+   for (i32 round = 0; round < num_rounds; ++round)
+   {
+      for (i32 level_index = 0; level_index < num_levels; ++level_index)
+      {
+         Level level;
+         if (parse_level(&level, all_levels[level_index], level_index))
+            load_level(&level, all_levels[level_index], benchmark->scratch);
+      }
+   }
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = (i64)num_rounds * num_levels;
+   return elapsed;
+}
+
+static f64
+bench_load_level_tables(Benchmark *benchmark, i64 *num_ops)
+{
+   i32 num_rounds = 20;
+
+   f64 begin_time = get_time();
+   for (i32 round = 0; round < num_rounds; ++round)
+   {
+      for (i32 level_index = 0; level_index < num_level_tables; ++level_index)
+      {
+         const Level_table *table = &all_level_tables[level_index];
+
+         Level level;
+         set_level_layout(&level, table->num_rows, table->num_cols, table->num_blocks);
+         load_level_table(&level, table, benchmark->scratch);
+      }
+   }
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = (i64)num_rounds * num_level_tables;
+   return elapsed;
+}
+
+// Endless mode levels, one operation is measuring and generating one level.
+static f64
+bench_generate_levels(Benchmark *benchmark, i64 *num_ops)
+{
+   i32 num_generated_levels = 100;
+   Level_generator_params params = default_level_generator_params();
+
+   f64 begin_time = get_time();
+   for (i32 level_index = 0; level_index < num_generated_levels; ++level_index)
+   {
+      u64 level_seed = generated_level_seed(BENCH_SEED, level_index);
+
+      Level level;
+      measure_generated_level(&level, &params, level_seed);
+      generate_level(&level, &params, level_seed, benchmark->scratch);
+   }
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = num_generated_levels;
+   return elapsed;
+}
+
+// One ball step among the blocks, from a fixed set of starting positions.
+static f64
+bench_move_ball(Benchmark *benchmark, i64 *num_ops)
+{
+   Game_state *game_state = benchmark->game_state;
+   Balls *balls = &game_state->balls;
+   game_restore(game_state, benchmark->snapshot);
+
+   f64 begin_time = get_time();
+   for (i32 i = 0; i < BENCH_NUM_BALL_STARTS; ++i)
+   {
+      balls->translations_x[0] = ball_starts[i].translation.x;
+      balls->translations_y[0] = ball_starts[i].translation.y;
+      balls->velocities_x[0] = ball_starts[i].velocity.x;
+      balls->velocities_y[0] = ball_starts[i].velocity.y;
+      move_ball(game_state, 0, SIMULATION_DT);
+   }
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = BENCH_NUM_BALL_STARTS;
+   return elapsed;
+}
+
+// A full pool of collectables falling until every one is caught or lost, one
+// operation is one update of the whole pool.
+static f64
+bench_update_collectables(Benchmark *benchmark, i64 *num_ops)
+{
+   Game_state *game_state = benchmark->game_state;
+   Collectables *collectables = &game_state->collectables;
+   game_restore(game_state, benchmark->snapshot);
+
+   for (i32 i = 0; i < Collectables::MAX_NUM_COLLECTABLES; ++i)
+   {
+      Collectable_type type = (Collectable_type)(COLLECTABLE_TYPE_LONG_PADDLE + i % COLLECTABLE_TYPE_BALL_SPLIT);
+      add_collectable(collectables, type, collectable_starts[i]);
+   }
+
+   i64 num_updates = 0;
+
+   f64 begin_time = get_time();
+   while (collectables->num_collectables)
+   {
+      update_collectables(game_state, SIMULATION_DT);
+      ++num_updates;
+   }
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = num_updates;
+   return elapsed;
+}
+
+// Plays the recorded session from the snapshot, one operation is one tick.
+static f64
+bench_replay(Benchmark *benchmark, i64 *num_ops)
+{
+   Game_state *game_state = benchmark->game_state;
+   game_restore(game_state, benchmark->snapshot);
+
+   Replay_player player;
+   replay_player_begin(&player, &benchmark->replay);
+
+   f64 begin_time = get_time();
+   Input input;
+   while (replay_next_input(&player, &input))
+      game_update(game_state, input, SIMULATION_DT);
+   f64 elapsed = get_time() - begin_time;
+
+   *num_ops = (i64)benchmark->replay.num_ticks;
+   return elapsed;
+}
+
+static Game_state *
+create_game(const char **level_texts, i32 level_count, i32 level_index)
+{
+   Game_state *game_state = (Game_state *)malloc(sizeof(Game_state));
+   if (!game_init(game_state, BENCH_SEED, level_texts, level_count))
+      exit(EXIT_FAILURE);
+
+   change_level(game_state, level_index);
+
+   return game_state;
+}
+
+static void *
+take_snapshot(Game_state *game_state)
+{
+   void *snapshot = malloc(game_snapshot_size(game_state));
+   game_snapshot(game_state, snapshot);
+
+   return snapshot;
+}
+
+// The SIMD block kernels against the scalar one, on boxes around random
+// blocks and on boxes spanned by two block centers, whose edges go exactly
+// through blocks, where >= and <= have to agree too. Destroying blocks
+// shuffles the slots between rounds.
+static bool
+check_block_kernels(Random_series *series)
+{
+   const char *level_text = make_filled_level_text(24, 64, series);
+   defer { free((void *)level_text); };
+
+   Game_state *game_state = create_game(&level_text, 1, 0);
+   defer { game_free(game_state); free(game_state); };
+   Level *level = game_state->level;
+
+   for (i32 round = 0; round < 4; ++round)
+   {
+      for (i32 i = 0; i < 256; ++i)
+      {
+         v2 corners[2];
+         for (i32 c = 0; c < 2; ++c)
+            corners[c] = block_translation(level, random_next_u32(series) % game_state->num_blocks_left);
+
+         v2 min_corner = V2(min(corners[0].x, corners[1].x), min(corners[0].y, corners[1].y));
+         v2 max_corner = V2(max(corners[0].x, corners[1].x), max(corners[0].y, corners[1].y));
+         if (i % 2)
+         {
+            v2 extent = V2(random_between(series, 0.0f, 0.2f), random_between(series, 0.0f, 0.2f));
+            min_corner = corners[0] - extent;
+            max_corner = corners[0] + extent;
+         }
+
+         if (!block_kernels_agree(level, min_corner, max_corner))
+            return false;
+      }
+
+      for (i32 i = 0; i < game_state->num_blocks_left / 4; ++i)
+         destroy_block(game_state, random_next_u32(series) % game_state->num_blocks_left);
+   }
+
+   return true;
+}
+
+static bool
+is_selected(const char *filter, const char *name)
+{
+   return !filter || strstr(name, filter);
+}
+
+// Returns 0 for benchmarks the filter leaves out, their setup is skipped too.
+static Benchmark *
+add_benchmark(Array<Benchmark *> *benchmarks, const char *filter, const char *name, Bench_function *function, i32 num_samples)
+{
+   if (!is_selected(filter, name))
+      return 0;
+
+   Benchmark *benchmark = (Benchmark *)calloc(1, sizeof(Benchmark));
+   snprintf(benchmark->name, sizeof(benchmark->name), "%s", name);
+   benchmark->function = function;
+   benchmark->num_samples = num_samples;
+   array_add(benchmarks, benchmark);
+
+   return benchmark;
+}
+
+// The bot plays warmup_ticks, then the next num_ticks are recorded as the
+// session every sample replays.
+static void
+add_replay_benchmark(Array<Benchmark *> *benchmarks, const char *filter, const char *name,
+                     const char **level_texts, i32 level_count, i32 level_index,
+                     i64 warmup_ticks, i64 num_ticks, i32 num_samples)
+{
+   Benchmark *benchmark = add_benchmark(benchmarks, filter, name, bench_replay, num_samples);
+   if (!benchmark)
+      return;
+
+   Game_state *game_state = create_game(level_texts, level_count, level_index);
+   benchmark->game_state = game_state;
+
+   i64 tick = 0;
+   for (; tick < warmup_ticks; ++tick)
+      game_update(game_state, bot_input(game_state, (u32)tick), SIMULATION_DT);
+
+   benchmark->snapshot = take_snapshot(game_state);
+
+   // The texts of levels.h are the built-in levels, not that the replay is
+   // ever written.
+   Replay_levels levels = replay_levels_built_in();
+   replay_begin(&benchmark->replay, BENCH_SEED, &levels);
+   for (; tick < warmup_ticks + num_ticks; ++tick)
+   {
+      Input input = bot_input(game_state, (u32)tick);
+      replay_record(&benchmark->replay, input);
+      game_update(game_state, input, SIMULATION_DT);
+   }
+   replay_end(&benchmark->replay, game_state);
+}
+
+static void
+add_benchmarks(Array<Benchmark *> *benchmarks, const char *filter)
+{
+   Random_series series = random_seed(BENCH_SEED);
+
+   for (i32 i = 0; i < BENCH_NUM_BALL_STARTS; ++i)
+   {
+      ball_starts[i].translation = V2(random_between(&series, -1.0f, 1.0f), random_between(&series, 0.0f, 1.0f));
+      ball_starts[i].velocity = v2_of_angle(random_between(&series, 0.0f, 2*PI32));
+   }
+   for (i32 i = 0; i < Collectables::MAX_NUM_COLLECTABLES; ++i)
+      collectable_starts[i] = V2(random_between(&series, -1.0f, 1.0f), random_between(&series, -0.9f, 1.0f));
+
+   // Micro.
+   {
+      size_t max_memory_size = 0;
+      for (i32 level_index = 0; level_index < num_levels; ++level_index)
+      {
+         Level level;
+         if (parse_level(&level, all_levels[level_index], level_index))
+            max_memory_size = max(max_memory_size, level.memory_size);
+      }
+
+      Benchmark *benchmark = add_benchmark(benchmarks, filter, "parse_levels", bench_parse_levels, 200);
+      if (benchmark)
+         benchmark->scratch = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, max_memory_size);
+
+      Benchmark *tables = add_benchmark(benchmarks, filter, "load_level_tables", bench_load_level_tables, 200);
+      if (tables)
+         tables->scratch = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, max_memory_size);
+   }
+   {
+      Benchmark *benchmark = add_benchmark(benchmarks, filter, "generate_levels", bench_generate_levels, 200);
+      if (benchmark)
+      {
+         Level_generator_params params = default_level_generator_params();
+
+         // Room for a level full of blocks.
+         Level level;
+         set_level_layout(&level, params.num_rows, params.num_cols, params.num_rows * params.num_cols);
+
+         benchmark->scratch = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, level.memory_size);
+      }
+   }
+   {
+      i32 densest_level_index = 0;
+      i32 max_num_blocks = 0;
+      for (i32 level_index = 0; level_index < num_levels; ++level_index)
+      {
+         Level level;
+         if (parse_level(&level, all_levels[level_index], level_index) && level.num_blocks > max_num_blocks)
+         {
+            densest_level_index = level_index;
+            max_num_blocks = level.num_blocks;
+         }
+      }
+
+      Benchmark *dense = add_benchmark(benchmarks, filter, "move_ball/dense", bench_move_ball, 500);
+      if (dense)
+      {
+         dense->game_state = create_game(all_levels, num_levels, densest_level_index);
+         dense->snapshot = take_snapshot(dense->game_state);
+      }
+
+      // Few enough blocks left for move_ball to test all of them with SIMD.
+      Benchmark *sparse = add_benchmark(benchmarks, filter, "move_ball/sparse", bench_move_ball, 500);
+      if (sparse)
+      {
+         sparse->game_state = create_game(all_levels, num_levels, densest_level_index);
+         while (sparse->game_state->num_blocks_left > 6)
+            destroy_block(sparse->game_state, 0);
+         sparse->game_state->collectables.num_collectables = 0;
+         sparse->snapshot = take_snapshot(sparse->game_state);
+      }
+   }
+   {
+      Benchmark *benchmark = add_benchmark(benchmarks, filter, "update_collectables", bench_update_collectables, 100);
+      if (benchmark)
+      {
+         Game_state *game_state = create_game(all_levels, num_levels, 0);
+         game_state->started = true;
+         benchmark->game_state = game_state;
+         benchmark->snapshot = take_snapshot(game_state);
+      }
+   }
+   add_replay_benchmark(benchmarks, filter, "game_update", all_levels, num_levels, 0, 2 * SIMULATION_TICK_RATE, 1000, 200);
+
+   // Macro.
+   for (i32 level_index = 0; level_index < num_levels; ++level_index)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "replay/level_%d", level_index+1);
+      add_replay_benchmark(benchmarks, filter, name, all_levels, num_levels, level_index, 0, 60 * SIMULATION_TICK_RATE, 20);
+   }
+
+   add_replay_benchmark(benchmarks, filter, "replay/split_blocks", &split_level_text, 1, 0, 0, 60 * SIMULATION_TICK_RATE, 20);
+
+   i32 synthetic_sizes[][2] = { { 24, 64 }, { 24, 160 } };
+   for (i32 i = 0; i < (i32)(sizeof(synthetic_sizes) / sizeof(synthetic_sizes[0])); ++i)
+   {
+      i32 num_rows = synthetic_sizes[i][0];
+      i32 num_cols = synthetic_sizes[i][1];
+
+      char name[64];
+      snprintf(name, sizeof(name), "replay/huge_%dx%d", num_rows, num_cols);
+      if (!is_selected(filter, name))
+         continue;
+
+      // Every generated level has a series of its own, so that it comes out
+      // the same whichever benchmarks are selected. Game_state only borrows
+      // the text while loading.
+      Random_series level_series = random_seed(BENCH_SEED + num_rows * num_cols);
+      const char *level_text = make_filled_level_text(num_rows, num_cols, &level_series);
+      defer { free((void *)level_text); };
+
+      add_replay_benchmark(benchmarks, filter, name, &level_text, 1, 0, 0, 60 * SIMULATION_TICK_RATE, 20);
+   }
+
+   // Tick time against block count, the scaling curve of the stress mode.
+   i32 stress_num_blocks[] = { 1000, 4000, 16000, 64000, 256000 };
+   for (i32 i = 0; i < (i32)(sizeof(stress_num_blocks) / sizeof(stress_num_blocks[0])); ++i)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "stress/%d_blocks", stress_num_blocks[i]);
+      if (!is_selected(filter, name))
+         continue;
+
+      Random_series level_series = random_seed(BENCH_SEED + stress_num_blocks[i]);
+      const char *level_text = make_stress_level_text(stress_num_blocks[i], &level_series);
+      defer { free((void *)level_text); };
+
+      add_replay_benchmark(benchmarks, filter, name, &level_text, 1, 0, 0, 60 * SIMULATION_TICK_RATE, 20);
+   }
+}
+
+static int
+compare_f64(const void *a, const void *b)
+{
+   f64 x = *(const f64 *)a;
+   f64 y = *(const f64 *)b;
+   return (x > y) - (x < y);
+}
+
+static Bench_result
+run_benchmark(Benchmark *benchmark)
+{
+   Bench_result result;
+   snprintf(result.name, sizeof(result.name), "%s", benchmark->name);
+   result.num_samples = benchmark->num_samples;
+
+   i64 num_ops;
+   benchmark->function(benchmark, &num_ops); // Warm up caches and branch predictors.
+
+   f64 *sample_ns = (f64 *)malloc(benchmark->num_samples * sizeof(f64));
+   defer { free(sample_ns); };
+
+   f64 total_time = 0.0;
+   i64 total_ops = 0;
+   for (i32 sample = 0; sample < benchmark->num_samples; ++sample)
+   {
+      f64 time = benchmark->function(benchmark, &num_ops);
+      sample_ns[sample] = time * 1e9 / num_ops;
+      total_time += time;
+      total_ops += num_ops;
+   }
+
+   qsort(sample_ns, benchmark->num_samples, sizeof(f64), compare_f64);
+
+   i32 last = benchmark->num_samples-1;
+   result.mean_ns = total_time * 1e9 / total_ops;
+   result.p50_ns = sample_ns[last * 50 / 100];
+   result.p90_ns = sample_ns[last * 90 / 100];
+   result.p99_ns = sample_ns[last * 99 / 100];
+   result.max_ns = sample_ns[last];
+
+   return result;
+}
+
+static bool
+write_json(const char *path, Bench_result *results, i32 num_results)
+{
+   FILE *file = fopen(path, "w");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open '%s' for writing.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   fprintf(file, "{\n");
+   fprintf(file, "  \"tick_rate\": %d,\n", SIMULATION_TICK_RATE);
+   fprintf(file, "  \"benchmarks\": [\n");
+   for (i32 i = 0; i < num_results; ++i)
+   {
+      Bench_result *result = &results[i];
+      fprintf(file, "    {\"name\": \"%s\", \"samples\": %d, \"mean_ns\": %.2f, \"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"max_ns\": %.2f}%s\n",
+            result->name,
+            result->num_samples,
+            result->mean_ns,
+            result->p50_ns,
+            result->p90_ns,
+            result->p99_ns,
+            result->max_ns,
+            i+1 < num_results ? "," : "");
+   }
+   fprintf(file, "  ]\n");
+   fprintf(file, "}\n");
+
+   return true;
+}
+
+// Reads back the benchmark lines of a file written by write_json.
+static bool
+read_json(const char *path, Array<Bench_result> *results)
+{
+   FILE *file = fopen(path, "r");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open baseline '%s'.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   char line[512];
+   while (fgets(line, sizeof(line), file))
+   {
+      const char *object = strstr(line, "{\"name\"");
+      if (!object)
+         continue;
+
+      Bench_result result;
+      if (sscanf(object, "{\"name\": \"%63[^\"]\", \"samples\": %d, \"mean_ns\": %lf, \"p50_ns\": %lf, \"p90_ns\": %lf, \"p99_ns\": %lf, \"max_ns\": %lf",
+                 result.name,
+                 &result.num_samples,
+                 &result.mean_ns,
+                 &result.p50_ns,
+                 &result.p90_ns,
+                 &result.p99_ns,
+                 &result.max_ns) == 7)
+         array_add(results, result);
+   }
+
+   return true;
+}
+
+i32
+main(i32 argc, char **argv)
+{
+   const char *filter = 0;
+   const char *json_path = 0;
+   const char *baseline_path = 0;
+   f64 threshold = 10.0;
+
+   for (i32 i = 1; i < argc; ++i)
+   {
+      if (strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+         filter = argv[++i];
+      else if (strcmp(argv[i], "--json") == 0 && i+1 < argc)
+         json_path = argv[++i];
+      else if (strcmp(argv[i], "--compare") == 0 && i+1 < argc)
+         baseline_path = argv[++i];
+      else if (strcmp(argv[i], "--threshold") == 0 && i+1 < argc)
+         threshold = atof(argv[++i]);
+      else
+      {
+         fprintf(stderr, "Usage: %s [--filter text] [--json file] [--compare baseline.json] [--threshold percent]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   Array<Bench_result> baseline = array_create<Bench_result>();
+   defer { array_free(baseline); };
+   if (baseline_path && !read_json(baseline_path, &baseline))
+      return EXIT_FAILURE;
+
+   {
+      Random_series series = random_seed(BENCH_SEED);
+      if (!check_block_kernels(&series))
+         return EXIT_FAILURE;
+   }
+
+   Array<Benchmark *> benchmarks = array_create<Benchmark *>();
+   defer { array_free(benchmarks); };
+   add_benchmarks(&benchmarks, filter);
+
+   Array<Bench_result> results = array_create<Bench_result>();
+   defer { array_free(results); };
+
+   printf("%-24s %7s %12s %12s %12s %12s %12s\n", "benchmark", "samples", "mean ns/op", "p50", "p90", "p99", "max");
+   for (Benchmark *benchmark : benchmarks)
+   {
+      Bench_result result = run_benchmark(benchmark);
+      array_add(&results, result);
+
+      printf("%-24s %7d %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+            result.name,
+            result.num_samples,
+            result.mean_ns,
+            result.p50_ns,
+            result.p90_ns,
+            result.p99_ns,
+            result.max_ns);
+   }
+
+   if (json_path && !write_json(json_path, results.data, results.length))
+      return EXIT_FAILURE;
+
+   i32 exit_code = EXIT_SUCCESS;
+
+   if (baseline_path)
+   {
+      printf("\n%-24s %12s %12s %9s\n", "benchmark", "baseline p50", "p50", "change");
+      for (Bench_result &result : results)
+      {
+         Bench_result *base = 0;
+         for (Bench_result &candidate : baseline)
+         {
+            if (strcmp(candidate.name, result.name) == 0)
+               base = &candidate;
+         }
+
+         if (!base)
+         {
+            printf("%-24s %12s %12.1f %9s\n", result.name, "-", result.p50_ns, "new");
+            continue;
+         }
+
+         f64 change = 100.0 * (result.p50_ns - base->p50_ns) / base->p50_ns;
+         bool regressed = change > threshold;
+         printf("%-24s %12.1f %12.1f %+8.1f%%%s\n", result.name, base->p50_ns, result.p50_ns, change, regressed ? "  REGRESSION" : "");
+
+         if (regressed)
+            exit_code = EXIT_FAILURE;
+      }
+   }
+
+   for (Benchmark *benchmark : benchmarks)
+   {
+      if (benchmark->game_state)
+         game_free(benchmark->game_state);
+      free(benchmark->game_state);
+      free(benchmark->snapshot);
+      free(benchmark->scratch);
+      replay_free(&benchmark->replay);
+      free(benchmark);
+   }
+
+   return exit_code;
+}
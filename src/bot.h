@@ -0,0 +1,40 @@
+#ifndef BOT_H
+#define BOT_H
+
+// Simple paddle bot used by the headless drivers. It launches the ball right
+// away and keeps the paddle under the lowest falling ball, aiming slightly
+// off-center so that the ball does not get stuck bouncing between the same
+// columns.
+inline Input
+bot_input(const Game_state *game_state, u32 tick)
+{
+   Input input = {};
+   input.launch = true;
+
+   const Balls *balls = &game_state->balls;
+   i32 target_ball = 0;
+   for (i32 i = 1; i < balls->num_balls; ++i)
+   {
+      bool falling = balls->velocities_y[i] < 0.0f;
+      bool target_falling = balls->velocities_y[target_ball] < 0.0f;
+      if ((falling && !target_falling) ||
+          (falling == target_falling && balls->translations_y[i] < balls->translations_y[target_ball]))
+         target_ball = i;
+   }
+
+   f32 aim_offset = 0.5f * game_state->paddle.body_half_width * sinf(0.01f * tick);
+   f32 target_x = game_state->paddle.translate.x;
+   if (balls->num_balls)
+      target_x = balls->translations_x[target_ball] + aim_offset;
+   f32 diff_x = target_x - game_state->paddle.translate.x;
+
+   f32 dead_zone = 0.01f;
+   if (diff_x < -dead_zone)
+      input.move_left = true;
+   else if (diff_x > dead_zone)
+      input.move_right = true;
+
+   return input;
+}
+
+#endif
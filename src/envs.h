@@ -0,0 +1,73 @@
+#ifndef ENVS_H
+#define ENVS_H
+
+#include <stdint.h>
+
+// Lockstep environment API for reinforcement-learning style stepping. Every
+// call advances all environments by one simulation tick with one action each.
+// Buffers are laid out env-major: observations_out holds
+// num_envs * ENVS_OBSERVATION_SIZE floats, the rest one element per env.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENVS_API __attribute__((visibility("default")))
+
+enum Envs_action
+{
+   ENVS_ACTION_NONE = 0,
+   ENVS_ACTION_LEFT,
+   ENVS_ACTION_RIGHT,
+   ENVS_ACTION_LAUNCH,
+};
+
+enum Envs_observation
+{
+   ENVS_OBSERVATION_PADDLE_X = 0,
+   ENVS_OBSERVATION_PADDLE_HALF_WIDTH,
+   // Lowest falling ball, or the lowest ball if none is falling.
+   ENVS_OBSERVATION_BALL_X,
+   ENVS_OBSERVATION_BALL_Y,
+   ENVS_OBSERVATION_BALL_VELOCITY_X,
+   ENVS_OBSERVATION_BALL_VELOCITY_Y,
+   ENVS_OBSERVATION_NUM_BALLS,
+   ENVS_OBSERVATION_BLOCKS_LEFT_FRACTION,
+   ENVS_OBSERVATION_LIVES_LEFT,
+   ENVS_OBSERVATION_STARTED,
+
+   ENVS_OBSERVATION_SIZE
+};
+
+typedef struct Envs Envs;
+
+// Env i is seeded with seed + i, the same seed gives the same episodes. Fails
+// and returns 0 unless num_envs is positive.
+ENVS_API Envs *
+envs_create(int32_t num_envs, uint64_t seed);
+ENVS_API void
+envs_destroy(Envs *envs);
+
+ENVS_API int32_t
+envs_count(const Envs *envs);
+
+// Reward is the number of blocks destroyed minus the number of lives lost. An
+// episode is done when the last life is lost or the last level is cleared,
+// the env is then reset on its own and dones_out is set to 1.
+ENVS_API void
+envs_step(Envs *envs, const int32_t *actions, float *observations_out, float *rewards_out, uint8_t *dones_out);
+
+// Starts a new episode in every env whose mask entry is non-zero, all envs if
+// mask is null.
+ENVS_API void
+envs_reset(Envs *envs, const uint8_t *mask);
+
+// Current observations without stepping, e.g. right after envs_create.
+ENVS_API void
+envs_observe(Envs *envs, float *observations_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
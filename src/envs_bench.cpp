@@ -0,0 +1,73 @@
+#include "envs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Steps a batch of envs with a trivial policy and reports env-steps/s.
+// Usage: envs_bench [num_envs] [num_steps]
+
+static double
+get_time()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(int argc, char **argv)
+{
+   int32_t num_envs = 4096;
+   int32_t num_steps = 10000;
+   if (argc > 1) num_envs = atoi(argv[1]);
+   if (argc > 2) num_steps = atoi(argv[2]);
+
+   Envs *envs = envs_create(num_envs, 1);
+   if (!envs)
+      return EXIT_FAILURE;
+
+   int32_t *actions = (int32_t *)malloc(num_envs * sizeof(int32_t));
+   float *observations = (float *)malloc(num_envs * ENVS_OBSERVATION_SIZE * sizeof(float));
+   float *rewards = (float *)malloc(num_envs * sizeof(float));
+   uint8_t *dones = (uint8_t *)malloc(num_envs * sizeof(uint8_t));
+
+   envs_observe(envs, observations);
+
+   double total_reward = 0.0;
+   long long num_episodes = 0;
+   double begin_time = get_time();
+
+   for (int32_t step = 0; step < num_steps; ++step)
+   {
+      // Follow the ball, launch when it is sitting on the paddle.
+      for (int32_t i = 0; i < num_envs; ++i)
+      {
+         float *observation = observations + i * ENVS_OBSERVATION_SIZE;
+         float diff = observation[ENVS_OBSERVATION_BALL_X] - observation[ENVS_OBSERVATION_PADDLE_X];
+
+         if (observation[ENVS_OBSERVATION_STARTED] == 0.0f) actions[i] = ENVS_ACTION_LAUNCH;
+         else if (diff < -0.01f) actions[i] = ENVS_ACTION_LEFT;
+         else if (diff > 0.01f) actions[i] = ENVS_ACTION_RIGHT;
+         else actions[i] = ENVS_ACTION_NONE;
+      }
+
+      envs_step(envs, actions, observations, rewards, dones);
+
+      for (int32_t i = 0; i < num_envs; ++i)
+      {
+         total_reward += rewards[i];
+         num_episodes += dones[i];
+      }
+   }
+
+   double elapsed = get_time() - begin_time;
+   double num_env_steps = (double)num_envs * num_steps;
+
+   printf("%d envs x %d steps in %.3fs (%.0f env-steps/s).\n", num_envs, num_steps, elapsed, num_env_steps / elapsed);
+   printf("Total reward %.0f, %lld episodes done.\n", total_reward, num_episodes);
+
+   envs_destroy(envs);
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#include "frame_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *frame_phase_names[FRAME_PHASE_COUNT] = {
+   "input",
+   "simulation",
+   "upload",
+   "draw",
+   "swap",
+};
+
+static const char *gpu_pass_names[GPU_PASS_COUNT] = {
+   "background",
+   "sprites",
+};
+
+static f64
+frame_stats_time()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+frame_stats_init(Frame_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
+void
+frame_stats_begin_frame(Frame_stats *stats)
+{
+   assert(!stats->in_frame);
+   stats->in_frame = true;
+   stats->frame_begin_time = frame_stats_time();
+   stats->phase_begin_time = stats->frame_begin_time;
+
+   for (i32 phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+      stats->current_phase_ms[phase] = 0.0f;
+   stats->current_upload_bytes = 0;
+}
+
+void
+frame_stats_end_phase(Frame_stats *stats, Frame_phase phase)
+{
+   f64 time = frame_stats_time();
+   stats->current_phase_ms[phase] += (f32)((time - stats->phase_begin_time) * 1000);
+   stats->phase_begin_time = time;
+}
+
+void
+frame_stats_add_upload_bytes(Frame_stats *stats, i64 num_bytes)
+{
+   stats->current_upload_bytes += num_bytes;
+}
+
+void
+frame_stats_end_frame(Frame_stats *stats)
+{
+   assert(stats->in_frame);
+   stats->in_frame = false;
+
+   i32 slot = (i32)(stats->num_frames % Frame_stats::MAX_FRAMES);
+
+   for (i32 phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+      stats->phase_ms[phase][slot] = stats->current_phase_ms[phase];
+   stats->total_ms[slot] = (f32)((frame_stats_time() - stats->frame_begin_time) * 1000);
+   stats->upload_bytes[slot] = (f32)stats->current_upload_bytes;
+
+   ++stats->num_frames;
+}
+
+void
+frame_stats_discard_frame(Frame_stats *stats)
+{
+   assert(stats->in_frame);
+   stats->in_frame = false;
+   ++stats->num_discarded_frames;
+}
+
+void
+frame_stats_add_gpu_frame(Frame_stats *stats, const f32 pass_ms[GPU_PASS_COUNT])
+{
+   i32 slot = (i32)(stats->num_gpu_frames % Frame_stats::MAX_FRAMES);
+
+   f32 total_ms = 0.0f;
+   for (i32 pass = 0; pass < GPU_PASS_COUNT; ++pass)
+   {
+      stats->gpu_pass_ms[pass][slot] = pass_ms[pass];
+      total_ms += pass_ms[pass];
+   }
+   stats->gpu_total_ms[slot] = total_ms;
+
+   ++stats->num_gpu_frames;
+}
+
+static int
+compare_f32(const void *a, const void *b)
+{
+   f32 x = *(const f32 *)a;
+   f32 y = *(const f32 *)b;
+   return (x > y) - (x < y);
+}
+
+static void
+print_percentiles(const char *name, const f32 *samples, i32 num_samples, i32 num_decimals = 3)
+{
+   f32 sorted[Frame_stats::MAX_FRAMES];
+   memcpy(sorted, samples, num_samples * sizeof(f32));
+   qsort(sorted, num_samples, sizeof(f32), compare_f32);
+
+   i32 last = num_samples-1;
+   printf("%-12s %8.*f %8.*f %8.*f %8.*f\n",
+         name,
+         num_decimals, sorted[last * 50 / 100],
+         num_decimals, sorted[last * 95 / 100],
+         num_decimals, sorted[last * 99 / 100],
+         num_decimals, sorted[last]);
+}
+
+void
+frame_stats_print(Frame_stats *stats)
+{
+   i32 num_samples = (i32)min(stats->num_frames, (i64)Frame_stats::MAX_FRAMES);
+   if (!num_samples)
+      return;
+
+   printf("\nLast %d of %lld frames [ms], %lld more were not drawn while paused:\n",
+         num_samples, (long long)stats->num_frames, (long long)stats->num_discarded_frames);
+   printf("%-12s %8s %8s %8s %8s\n", "phase", "p50", "p95", "p99", "max");
+   for (i32 phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+      print_percentiles(frame_phase_names[phase], stats->phase_ms[phase], num_samples);
+   print_percentiles("total", stats->total_ms, num_samples);
+
+   printf("\nUploads, last %d frames [bytes]:\n", num_samples);
+   printf("%-12s %8s %8s %8s %8s\n", "", "p50", "p95", "p99", "max");
+   print_percentiles("upload", stats->upload_bytes, num_samples, 0);
+
+   i32 num_gpu_samples = (i32)min(stats->num_gpu_frames, (i64)Frame_stats::MAX_FRAMES);
+   if (num_gpu_samples)
+   {
+      printf("\nGPU passes, last %d of %lld timed frames [ms]:\n", num_gpu_samples, (long long)stats->num_gpu_frames);
+      printf("%-12s %8s %8s %8s %8s\n", "pass", "p50", "p95", "p99", "max");
+      for (i32 pass = 0; pass < GPU_PASS_COUNT; ++pass)
+         print_percentiles(gpu_pass_names[pass], stats->gpu_pass_ms[pass], num_gpu_samples);
+      print_percentiles("total", stats->gpu_total_ms, num_gpu_samples);
+   }
+
+   // Frame times in power of two buckets: < 1ms, 1-2ms, ..., >= 32ms.
+   const i32 num_buckets = 7;
+   i32 bucket_counts[num_buckets] = {};
+   for (i32 i = 0; i < num_samples; ++i)
+   {
+      i32 bucket = 0;
+      for (f32 limit = 1.0f; bucket < num_buckets-1 && stats->total_ms[i] >= limit; limit *= 2)
+         ++bucket;
+      ++bucket_counts[bucket];
+   }
+
+   printf("\nFrame time histogram:\n");
+   for (i32 bucket = 0; bucket < num_buckets; ++bucket)
+   {
+      char label[32];
+      if (bucket == 0)
+         snprintf(label, sizeof(label), "< 1 ms");
+      else if (bucket == num_buckets-1)
+         snprintf(label, sizeof(label), ">= %d ms", 1 << (bucket-1));
+      else
+         snprintf(label, sizeof(label), "%d - %d ms", 1 << (bucket-1), 1 << bucket);
+
+      i32 bar_length = (bucket_counts[bucket] * 50 + num_samples-1) / num_samples;
+      printf("%12s %6d ", label, bucket_counts[bucket]);
+      for (i32 i = 0; i < bar_length; ++i)
+         putchar('#');
+      putchar('\n');
+   }
+}
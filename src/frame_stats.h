@@ -0,0 +1,80 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include "base.h"
+
+// Splits every frame into phases and keeps the CPU time spent in each of them
+// for the last MAX_FRAMES frames, so that percentiles can be reported without
+// printing anything while the game runs.
+
+enum Frame_phase
+{
+   FRAME_PHASE_INPUT = 0,
+   FRAME_PHASE_SIMULATION,
+   FRAME_PHASE_UPLOAD,
+   FRAME_PHASE_DRAW,
+   FRAME_PHASE_SWAP,
+
+   FRAME_PHASE_COUNT,
+};
+
+// Draw passes timed on the GPU by the renderer.
+enum Gpu_pass
+{
+   GPU_PASS_BACKGROUND = 0,
+   GPU_PASS_SPRITES,
+
+   GPU_PASS_COUNT,
+};
+
+struct Frame_stats
+{
+   static const i32 MAX_FRAMES = 1024;
+
+   // Ring buffers, frame i is stored at i % MAX_FRAMES.
+   f32 phase_ms[FRAME_PHASE_COUNT][MAX_FRAMES];
+   f32 total_ms[MAX_FRAMES];
+   i64 num_frames;
+
+   // Bytes the frame sent to the GPU.
+   f32 upload_bytes[MAX_FRAMES];
+
+   // Frames that were begun and then discarded instead of ended, the ones
+   // skipped while the game is paused.
+   i64 num_discarded_frames;
+
+   bool in_frame;
+   f64 frame_begin_time;
+   f64 phase_begin_time;
+   f32 current_phase_ms[FRAME_PHASE_COUNT];
+   i64 current_upload_bytes;
+
+   // GPU results arrive a few frames late and some may be skipped, so they
+   // have a ring of their own.
+   f32 gpu_pass_ms[GPU_PASS_COUNT][MAX_FRAMES];
+   f32 gpu_total_ms[MAX_FRAMES];
+   i64 num_gpu_frames;
+};
+
+void
+frame_stats_init(Frame_stats *stats);
+// Every frame that is begun has to be ended or discarded.
+void
+frame_stats_begin_frame(Frame_stats *stats);
+// Adds the time since the previous phase ended (or the frame began) to phase.
+void
+frame_stats_end_phase(Frame_stats *stats, Frame_phase phase);
+void
+frame_stats_add_upload_bytes(Frame_stats *stats, i64 num_bytes);
+void
+frame_stats_end_frame(Frame_stats *stats);
+// Drops the frame that is in progress, its phases are not counted.
+void
+frame_stats_discard_frame(Frame_stats *stats);
+void
+frame_stats_add_gpu_frame(Frame_stats *stats, const f32 pass_ms[GPU_PASS_COUNT]);
+
+void
+frame_stats_print(Frame_stats *stats);
+
+#endif
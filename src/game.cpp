@@ -0,0 +1,1261 @@
+#include "game.h"
+#include "level_compiler.h"
+#include "simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+void
+set_level_layout(Level *level, i32 num_rows, i32 num_cols, i32 num_blocks)
+{
+   level->num_rows = num_rows;
+   level->num_cols = num_cols;
+   level->num_blocks = num_blocks;
+   level->num_padded_blocks = (num_blocks + BLOCK_LANES-1) / BLOCK_LANES * BLOCK_LANES;
+
+   i32 num_cells = num_rows * num_cols;
+   i32 num_alive_words = (num_cells + 63) / 64;
+   size_t translations_num_bytes = 2 * level->num_padded_blocks * sizeof(f32);
+   size_t blocks_num_bytes = num_blocks * (sizeof(v3) + sizeof(Collectable_type) + sizeof(i32));
+   size_t cells_num_bytes = num_cells * sizeof(i32);
+   size_t alive_offset = (translations_num_bytes + blocks_num_bytes + cells_num_bytes + 7) & ~(size_t)7;
+   size_t total_num_bytes = alive_offset + num_alive_words * sizeof(u64);
+
+   level->memory_size = (total_num_bytes + LEVEL_MEMORY_ALIGNMENT-1) / LEVEL_MEMORY_ALIGNMENT * LEVEL_MEMORY_ALIGNMENT;
+
+   f32 block_width = level_block_width(num_cols);
+   f32 block_height = level_block_height(num_rows);
+   level->block_half_width = 0.5f * block_width;
+   level->block_half_height = 0.5f * block_height;
+   level->cell_width = block_width + level_padding_x(num_cols);
+   level->cell_height = block_height + level_padding_y(num_rows);
+}
+
+void
+place_level_arrays(Level *level, void *memory)
+{
+   // translations x ..., translations y ..., colors ..., collectable types ...,
+   // block cells ..., cell blocks ..., alive cells ...
+   i32 num_cells = level->num_rows * level->num_cols;
+
+   level->translations_x = (f32 *)memory;
+   level->translations_y = level->translations_x + level->num_padded_blocks;
+   level->colors = (v3 *)(level->translations_y + level->num_padded_blocks);
+   level->collectable_types = (Collectable_type *)(level->colors + level->num_blocks);
+   level->block_cells = (i32 *)(level->collectable_types + level->num_blocks);
+   level->cell_blocks = level->block_cells + level->num_blocks;
+   level->alive_cells = (u64 *)(((uintptr_t)(level->cell_blocks + num_cells) + 7) & ~(uintptr_t)7);
+
+   for (i32 i = level->num_blocks; i < level->num_padded_blocks; ++i)
+   {
+      level->translations_x[i] = BLOCK_PADDING_POSITION;
+      level->translations_y[i] = BLOCK_PADDING_POSITION;
+   }
+}
+
+v3
+block_color(Collectable_type type)
+{
+   switch (type)
+   {
+      case COLLECTABLE_TYPE_NONE: return Colors::RED;
+      case COLLECTABLE_TYPE_LONG_PADDLE: return Colors::GREEN;
+      case COLLECTABLE_TYPE_SHORT_PADDLE: return Colors::BLUE;
+      case COLLECTABLE_TYPE_FAST_BALL: return Colors::YELLOW;
+      case COLLECTABLE_TYPE_SLOW_BALL: return Colors::PURPLE;
+      case COLLECTABLE_TYPE_BALL_SPLIT: return Colors::PURPLE;
+   }
+
+   return Colors::RED;
+}
+
+bool
+parse_level(Level *level, const char *level_symbols, i32 level_index)
+{
+   PROFILE_ZONE("parse_level");
+
+   Level_text_size size = measure_level_text(level_symbols);
+   switch (size.error)
+   {
+      case LEVEL_TEXT_ERROR_NONE: break;
+
+      case LEVEL_TEXT_ERROR_UNKNOWN_SYMBOL: {
+         fprintf(stderr, "Unknown character '%c' in level %d text.\n", size.error_symbol, level_index+1);
+         return false;
+      }
+      case LEVEL_TEXT_ERROR_INCONSISTENT_COLUMNS: {
+         fprintf(stderr, "Inconsitent number of columns in level %d text (row %d, expected %d, actual %d).\n",
+               level_index+1,
+               size.error_row+1,
+               size.num_cols,
+               size.error_num_cols);
+         return false;
+      }
+      case LEVEL_TEXT_ERROR_MISSING_NEWLINE: {
+         fprintf(stderr, "Expected newline at the end of level %d text.\n", level_index+1);
+         return false;
+      }
+   }
+
+   set_level_layout(level, size.num_rows, size.num_cols, size.num_blocks);
+
+   return true;
+}
+
+void
+load_level(Level *level, const char *level_symbols, void *memory)
+{
+   PROFILE_ZONE("load_level");
+
+   place_level_arrays(level, memory);
+   fill_level_blocks(level_symbols, level->num_rows, level->num_cols,
+         level->translations_x, level->translations_y, level->collectable_types,
+         level->block_cells, level->cell_blocks, level->alive_cells);
+
+   for (i32 block_index = 0; block_index < level->num_blocks; ++block_index)
+      level->colors[block_index] = block_color(level->collectable_types[block_index]);
+}
+
+void
+load_level_table(Level *level, const Level_table *table, void *memory)
+{
+   PROFILE_ZONE("load_level_table");
+
+   place_level_arrays(level, memory);
+
+   i32 num_cells = level->num_rows * level->num_cols;
+   i32 num_alive_words = (num_cells + 63) / 64;
+   memcpy(level->translations_x, table->translations_x, level->num_blocks * sizeof(f32));
+   memcpy(level->translations_y, table->translations_y, level->num_blocks * sizeof(f32));
+   memcpy(level->collectable_types, table->collectable_types, level->num_blocks * sizeof(Collectable_type));
+   memcpy(level->block_cells, table->block_cells, level->num_blocks * sizeof(i32));
+   memcpy(level->cell_blocks, table->cell_blocks, num_cells * sizeof(i32));
+   memcpy(level->alive_cells, table->alive_cells, num_alive_words * sizeof(u64));
+
+   for (i32 block_index = 0; block_index < level->num_blocks; ++block_index)
+      level->colors[block_index] = block_color(level->collectable_types[block_index]);
+}
+
+Cell_range
+cells_overlapping(Level *level, v2 min_corner, v2 max_corner)
+{
+   // Centers of the blocks in the first column and the first row.
+   f32 origin_x = -1.0f + level->block_half_width;
+   f32 origin_y = 1.0f - level->block_half_height;
+
+   // Rounded outwards, callers still have to test the blocks exactly.
+   Cell_range range;
+   range.min_col = (i32)floorf((min_corner.x - origin_x) / level->cell_width);
+   range.max_col = (i32)ceilf((max_corner.x - origin_x) / level->cell_width);
+   range.min_row = (i32)floorf((origin_y - max_corner.y) / level->cell_height);
+   range.max_row = (i32)ceilf((origin_y - min_corner.y) / level->cell_height);
+
+   range.min_col = max(range.min_col, 0);
+   range.max_col = min(range.max_col, level->num_cols-1);
+   range.min_row = max(range.min_row, 0);
+   range.max_row = min(range.max_row, level->num_rows-1);
+
+   return range;
+}
+
+bool
+is_cell_alive(Level *level, i32 cell)
+{
+   return (level->alive_cells[cell / 64] >> (cell % 64)) & 1;
+}
+
+char *
+make_filled_level_text(i32 num_rows, i32 num_cols, Random_series *series)
+{
+   const char symbols[] = {
+      BOARD_SYMBOL_BLOCK_LONG_PADDLE,
+      BOARD_SYMBOL_BLOCK_SHORT_PADDLE,
+      BOARD_SYMBOL_BLOCK_FAST_BALL,
+      BOARD_SYMBOL_BLOCK_SLOW_BALL,
+      BOARD_SYMBOL_BLOCK_BALL_SPLIT,
+   };
+
+   char *text = (char *)malloc(num_rows * (num_cols+1) + 1);
+   char *at = text;
+
+   // Stress levels roll hundreds of thousands of cells, they are drawn
+   // RANDOM_LANES at a time from streams seeded off the series.
+   u64 seeds[RANDOM_LANES];
+   for (i32 lane = 0; lane < RANDOM_LANES; ++lane)
+      seeds[lane] = ((u64)random_next_u32(series) << 32) | random_next_u32(series);
+   Random_series_wide wide_series = random_seed_wide(seeds);
+
+   u32 draws[RANDOM_LANES];
+   i32 num_draws_left = 0;
+
+   for (i32 row = 0; row < num_rows; ++row)
+   {
+      for (i32 col = 0; col < num_cols; ++col)
+      {
+         if (num_draws_left == 0)
+         {
+            random_next_u32_wide(&wide_series, draws);
+            num_draws_left = RANDOM_LANES;
+         }
+
+         u32 r = draws[--num_draws_left] >> 8;
+         if (r % 16 == 0)
+            *at++ = symbols[(r / 16) % (sizeof(symbols) / sizeof(symbols[0]))];
+         else
+            *at++ = BOARD_SYMBOL_BLOCK_NORMAL;
+      }
+      *at++ = BOARD_SYMBOL_NEW_ROW;
+   }
+   *at = 0;
+
+   return text;
+}
+
+char *
+make_stress_level_text(i32 num_blocks, Random_series *series)
+{
+   // About twice as wide as tall, like the area the blocks are scaled into.
+   i32 num_cols = max((i32)ceilf(sqrtf(2.0f * num_blocks)), 1);
+   i32 num_rows = max((num_blocks + num_cols-1) / num_cols, 1);
+
+   return make_filled_level_text(num_rows, num_cols, series);
+}
+
+Level_table
+level_table_of(const Level *level)
+{
+   Level_table table;
+   table.num_rows = level->num_rows;
+   table.num_cols = level->num_cols;
+   table.num_blocks = level->num_blocks;
+   table.translations_x = level->translations_x;
+   table.translations_y = level->translations_y;
+   table.collectable_types = level->collectable_types;
+   table.block_cells = level->block_cells;
+   table.cell_blocks = level->cell_blocks;
+   table.alive_cells = level->alive_cells;
+
+   return table;
+}
+
+void
+reserve_level_slot(Level_slot *slot, size_t memory_size)
+{
+   if (memory_size <= slot->memory_capacity)
+      return;
+
+   free(slot->memory);
+   slot->memory = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, memory_size);
+   slot->memory_capacity = memory_size;
+}
+
+void
+load_level_table_slot(Level_slot *slot, const Level_table *table, i32 level_index)
+{
+   set_level_layout(&slot->level, table->num_rows, table->num_cols, table->num_blocks);
+   reserve_level_slot(slot, max(slot->level.memory_size, LEVEL_MEMORY_ALIGNMENT));
+   load_level_table(&slot->level, table, slot->memory);
+   slot->level_index = level_index;
+}
+
+void
+load_level_slot(Level_slot *slot, const Level_source *source, i32 level_index)
+{
+   source->load(source->data, level_index, slot);
+}
+
+static void
+load_level_table_at(const void *data, i32 level_index, Level_slot *slot)
+{
+   load_level_table_slot(slot, &((const Level_table *)data)[level_index], level_index);
+}
+
+bool
+game_init(Game_state *game_state, u64 seed)
+{
+   return game_init(game_state, seed, all_level_tables, num_level_tables);
+}
+
+bool
+game_init(Game_state *game_state, u64 seed, Level_source source, i32 level_count)
+{
+   PROFILE_ZONE("game_init");
+
+   if (level_count <= 0)
+   {
+      fprintf(stderr, "There are no levels to play.\n");
+      return false;
+   }
+
+   game_state->random_series = random_seed(seed);
+
+   All_levels_data *all_levels_data = &game_state->all_levels_data;
+   {
+      all_levels_data->source = source;
+      all_levels_data->num_levels = level_count;
+      all_levels_data->text_tables = 0;
+      all_levels_data->text_memory = 0;
+
+      Level_slot *slots = (Level_slot *)calloc(2, sizeof(Level_slot));
+      slots[0].level_index = -1;
+      slots[1].level_index = -1;
+      all_levels_data->current = &slots[0];
+      all_levels_data->next = &slots[1];
+      all_levels_data->next_level_index = -1;
+      all_levels_data->next_state = LEVEL_PREFETCH_NONE;
+   }
+
+   init_game_objects(game_state);
+
+   return true;
+}
+
+bool
+game_init(Game_state *game_state, u64 seed, const Level_table *level_tables, i32 level_count)
+{
+   Level_source source;
+   source.data = level_tables;
+   source.load = load_level_table_at;
+
+   return game_init(game_state, seed, source, level_count);
+}
+
+bool
+game_init(Game_state *game_state, u64 seed, const char **level_texts, i32 level_count)
+{
+   Level *levels = (Level *)malloc(level_count * sizeof(Level));
+   defer { free(levels); };
+
+   size_t memory_size = 0;
+   for (i32 level_index = 0; level_index < level_count; ++level_index)
+   {
+      if (!parse_level(&levels[level_index], level_texts[level_index], level_index))
+         return false;
+
+      memory_size += levels[level_index].memory_size;
+   }
+
+   u8 *text_memory = (u8 *)aligned_alloc(LEVEL_MEMORY_ALIGNMENT, max(memory_size, LEVEL_MEMORY_ALIGNMENT));
+   Level_table *text_tables = (Level_table *)malloc(level_count * sizeof(Level_table));
+
+   u8 *level_memory = text_memory;
+   for (i32 level_index = 0; level_index < level_count; ++level_index)
+   {
+      Level *level = &levels[level_index];
+      load_level(level, level_texts[level_index], level_memory);
+      text_tables[level_index] = level_table_of(level);
+      level_memory += level->memory_size;
+   }
+
+   if (!game_init(game_state, seed, text_tables, level_count))
+   {
+      free(text_tables);
+      free(text_memory);
+      return false;
+   }
+
+   game_state->all_levels_data.text_tables = text_tables;
+   game_state->all_levels_data.text_memory = text_memory;
+
+   return true;
+}
+
+void
+init_game_objects(Game_state *game_state)
+{
+   Paddle *paddle = &game_state->paddle;
+   {
+      paddle->translate = V2(0.0f, 0.0f);
+      paddle->speed = 2.0f;
+
+      f32 body_width = 0.2f;
+      f32 body_height = 0.035f;
+
+      paddle->body_half_width = 0.5f * body_width;
+      paddle->body_half_height = 0.5f * body_height;
+      paddle->segment_length = body_width / paddle->NUM_SEGMENTS;
+
+      f32 deg_to_rad = PI32 / 180;
+      paddle->segment_bounce_angles[0] = 140 * deg_to_rad;
+      paddle->segment_bounce_angles[1] = 115 * deg_to_rad;
+      paddle->segment_bounce_angles[2] = 100 * deg_to_rad;
+      paddle->segment_bounce_angles[3] = 80 * deg_to_rad;
+      paddle->segment_bounce_angles[4] = 65 * deg_to_rad;
+      paddle->segment_bounce_angles[5] = 40 * deg_to_rad;
+   }
+
+   Balls *balls = &game_state->balls;
+   {
+      balls->num_balls = 0;
+      balls->capacity = 0;
+      balls->memory = 0;
+      reserve_balls(balls, Balls::INITIAL_CAPACITY);
+
+      balls->radius = 0.025f;
+      balls->half_radius = 0.5f * balls->radius;
+   }
+
+   Collectables *collectables = &game_state->collectables;
+   {
+      collectables->num_collectables = 0;
+      collectables->fall_speed = 0.5f;
+
+      f32 body_width = 0.1f;
+      f32 body_height = 0.05f;
+      collectables->body_half_width = 0.5f * body_width;
+      collectables->body_half_height = 0.5f * body_height;
+   }
+
+   game_state->paused = false;
+   game_state->pause_was_down = false;
+   game_state->blocks_version = 0;
+   game_state->lives_left = game_state->INITIAL_LIVES;
+   change_level(game_state, 0);
+}
+
+void
+game_free(Game_state *game_state)
+{
+   All_levels_data *all_levels_data = &game_state->all_levels_data;
+   assert(all_levels_data->next_state != LEVEL_PREFETCH_LOADING);
+
+   // Both slots come from a single allocation, current may point at either.
+   Level_slot *slots = min(all_levels_data->current, all_levels_data->next);
+   free(all_levels_data->current->memory);
+   free(all_levels_data->next->memory);
+   free(slots);
+   free(all_levels_data->text_tables);
+   free(all_levels_data->text_memory);
+   free(game_state->balls.memory);
+
+   all_levels_data->current = 0;
+   all_levels_data->next = 0;
+   all_levels_data->text_tables = 0;
+   all_levels_data->text_memory = 0;
+   all_levels_data->num_levels = 0;
+   game_state->level = 0;
+   game_state->balls.memory = 0;
+   game_state->balls.capacity = 0;
+}
+
+i32
+claim_level_prefetch(Game_state *game_state)
+{
+   All_levels_data *all_levels_data = &game_state->all_levels_data;
+
+   if (game_state->wait_event != WAIT_EVENT_NEXT_LEVEL)
+      return -1;
+
+   i32 level_index = game_state->level_index + 1;
+   if (level_index == all_levels_data->num_levels)
+      return -1;
+
+   // Only this thread starts prefetches, so the state cannot change to loading
+   // behind its back.
+   i32 state = __atomic_load_n(&all_levels_data->next_state, __ATOMIC_ACQUIRE);
+   if (state == LEVEL_PREFETCH_LOADING ||
+       (state == LEVEL_PREFETCH_READY && all_levels_data->next_level_index == level_index))
+      return -1;
+
+   all_levels_data->next_level_index = level_index;
+   __atomic_store_n(&all_levels_data->next_state, LEVEL_PREFETCH_LOADING, __ATOMIC_RELAXED);
+
+   return level_index;
+}
+
+void
+prefetch_level(All_levels_data *all_levels_data, i32 level_index)
+{
+   PROFILE_ZONE("prefetch_level");
+
+   load_level_slot(all_levels_data->next, &all_levels_data->source, level_index);
+   __atomic_store_n(&all_levels_data->next_state, LEVEL_PREFETCH_READY, __ATOMIC_RELEASE);
+}
+
+size_t
+game_snapshot_size(const Game_state *game_state)
+{
+   return sizeof(Game_snapshot_header) + sizeof(Game_state) + sizeof(Level) + game_state->level->memory_size +
+          Balls::NUM_ARRAYS * game_state->balls.num_balls * sizeof(f32);
+}
+
+static void
+place_ball_arrays(Balls *balls, f32 *memory, i32 capacity)
+{
+   balls->memory = memory;
+   balls->capacity = capacity;
+   balls->translations_x = memory;
+   balls->translations_y = memory + capacity;
+   balls->prev_translations_x = memory + 2 * capacity;
+   balls->prev_translations_y = memory + 3 * capacity;
+   balls->velocities_x = memory + 4 * capacity;
+   balls->velocities_y = memory + 5 * capacity;
+   balls->speeds = memory + 6 * capacity;
+}
+
+// The arrays of the pool in the order in which snapshots store them.
+static void
+ball_arrays(const Balls *balls, f32 *arrays[Balls::NUM_ARRAYS])
+{
+   arrays[0] = balls->translations_x;
+   arrays[1] = balls->translations_y;
+   arrays[2] = balls->prev_translations_x;
+   arrays[3] = balls->prev_translations_y;
+   arrays[4] = balls->velocities_x;
+   arrays[5] = balls->velocities_y;
+   arrays[6] = balls->speeds;
+}
+
+void
+game_snapshot(const Game_state *game_state, void *buffer)
+{
+   const Level *level = game_state->level;
+   const Balls *balls = &game_state->balls;
+
+   Game_snapshot_header *header = (Game_snapshot_header *)buffer;
+   header->num_bytes = game_snapshot_size(game_state);
+   header->state_offset = sizeof(Game_snapshot_header);
+   header->level_offset = header->state_offset + sizeof(Game_state);
+   header->level_memory_offset = header->level_offset + sizeof(Level);
+   header->level_memory_size = level->memory_size;
+   header->balls_offset = header->level_memory_offset + level->memory_size;
+
+   memcpy((u8 *)buffer + header->state_offset, game_state, sizeof(Game_state));
+   memcpy((u8 *)buffer + header->level_offset, level, sizeof(Level));
+   memcpy((u8 *)buffer + header->level_memory_offset, level->translations_x, level->memory_size);
+
+   f32 *arrays[Balls::NUM_ARRAYS];
+   ball_arrays(balls, arrays);
+   f32 *balls_data = (f32 *)((u8 *)buffer + header->balls_offset);
+   for (i32 i = 0; i < Balls::NUM_ARRAYS; ++i)
+      memcpy(balls_data + i * balls->num_balls, arrays[i], balls->num_balls * sizeof(f32));
+}
+
+void
+game_restore(Game_state *game_state, const void *buffer)
+{
+   const Game_snapshot_header *header = (const Game_snapshot_header *)buffer;
+
+   // Pointers stored in the snapshot may belong to another game, only the
+   // target's own are kept.
+   All_levels_data all_levels_data = game_state->all_levels_data;
+   u32 blocks_version = game_state->blocks_version;
+   f32 *balls_memory = game_state->balls.memory;
+   i32 balls_capacity = game_state->balls.capacity;
+
+   memcpy(game_state, (const u8 *)buffer + header->state_offset, sizeof(Game_state));
+
+   Level_slot *current = all_levels_data.current;
+   reserve_level_slot(current, max(header->level_memory_size, LEVEL_MEMORY_ALIGNMENT));
+   memcpy(&current->level, (const u8 *)buffer + header->level_offset, sizeof(Level));
+   memcpy(current->memory, (const u8 *)buffer + header->level_memory_offset, header->level_memory_size);
+   place_level_arrays(&current->level, current->memory);
+   current->level_index = game_state->level_index;
+
+   // Nothing in the target's pool is kept, it only grows without copying.
+   Balls *balls = &game_state->balls;
+   i32 num_balls = balls->num_balls;
+   place_ball_arrays(balls, balls_memory, balls_capacity);
+   balls->num_balls = 0;
+   reserve_balls(balls, num_balls);
+   balls->num_balls = num_balls;
+
+   f32 *arrays[Balls::NUM_ARRAYS];
+   ball_arrays(balls, arrays);
+   const f32 *balls_data = (const f32 *)((const u8 *)buffer + header->balls_offset);
+   for (i32 i = 0; i < Balls::NUM_ARRAYS; ++i)
+      memcpy(arrays[i], balls_data + i * num_balls, num_balls * sizeof(f32));
+
+   game_state->all_levels_data = all_levels_data;
+   game_state->level = &current->level;
+   // A fresh version, the restored one may have been seen with different blocks.
+   game_state->blocks_version = blocks_version;
+   log_block_change(game_state, BLOCK_CHANGE_ALL);
+}
+
+void
+game_update(Game_state *game_state, const Input &input, f32 dt)
+{
+   PROFILE_ZONE("game_update");
+
+   if (!game_state->pause_was_down && input.pause)
+      game_state->paused = !game_state->paused;
+   game_state->pause_was_down = input.pause;
+
+   if (game_state->paused)
+      return;
+
+   save_previous_translations(game_state);
+
+   if (game_state->wait_event != WAIT_EVENT_NONE)
+   {
+      game_state->wait_time_left -= dt;
+      if (game_state->wait_time_left <= 0.0f)
+         resolve_wait_event(game_state);
+
+      return;
+   }
+
+   Paddle *paddle = &game_state->paddle;
+   Balls *balls = &game_state->balls;
+
+   bool game_over = false;
+   bool restart_requested = false;
+   bool level_complete = false;
+
+   if (input.launch)
+      game_state->started = true;
+   if (input.restart)
+      restart_requested = true;
+
+   f32 paddle_velocity_x = 0.0f;
+   if (input.move_left)
+      paddle_velocity_x -= paddle->speed;
+   if (input.move_right)
+      paddle_velocity_x += paddle->speed;
+   paddle->translate.x += dt * paddle_velocity_x;
+
+   f32 max_left = -1.0f + paddle->body_half_width;
+   f32 max_right = 1.0f - paddle->body_half_width;
+   if (paddle->translate.x > max_right)
+      paddle->translate.x = max_right;
+   if (paddle->translate.x < max_left)
+      paddle->translate.x = max_left;
+
+   if (game_state->started)
+   {
+      update_collectables(game_state, dt);
+
+      // Update balls.
+      {
+         PROFILE_ZONE("update_balls");
+
+         for (i32 ball_index = 0; ball_index < balls->num_balls;)
+         {
+            // Moving player could bump into the ball. In that case disconnect two bodies
+            // by pushing the ball out of the paddle along the shallower axis.
+            v2 ball_player_diff = V2(balls->translations_x[ball_index], balls->translations_y[ball_index]) - paddle->translate;
+            if (ball_player_diff.y >= 0.0f)
+            {
+               f32 overlap_x = paddle->body_half_width + balls->half_radius - abs(ball_player_diff.x);
+               f32 overlap_y = paddle->body_half_height + balls->half_radius - ball_player_diff.y;
+
+               if (overlap_x >= 0.0f && overlap_y >= 0.0f)
+               {
+                  f32 eps = 0.001f;
+                  if (overlap_y < overlap_x)
+                     balls->translations_y[ball_index] += overlap_y + eps;
+                  else if (ball_player_diff.x < 0.0f)
+                     balls->translations_x[ball_index] -= overlap_x + eps;
+                  else
+                     balls->translations_x[ball_index] += overlap_x + eps;
+               }
+            }
+
+            move_ball(game_state, ball_index, dt);
+
+            // Life is lost only when the last ball leaves the screen.
+            if (balls->translations_y[ball_index] < -1.1f - balls->half_radius)
+               remove_ball(balls, ball_index);
+            else
+               ++ball_index;
+         }
+      }
+
+      if (balls->num_balls == 0)
+         game_over = true;
+      if (game_state->num_blocks_left == 0)
+         level_complete = true;
+   }
+   else
+   {
+      ball_follow_paddle(balls, paddle);
+   }
+
+   if (restart_requested)
+   {
+      game_state->lives_left = game_state->INITIAL_LIVES;
+      change_level(game_state, game_state->level_index);
+   }
+   else if (game_over)
+   {
+      game_state->wait_event = WAIT_EVENT_GAME_OVER;
+      game_state->wait_time_left = 0.7f;
+   }
+   else if (level_complete)
+   {
+      game_state->wait_event = WAIT_EVENT_NEXT_LEVEL;
+      game_state->wait_time_left = 1.0f;
+   }
+}
+
+// Moves collectables down, applies the ones caught by the paddle and removes
+// those that were caught or fell off the screen.
+void
+update_collectables(Game_state *game_state, f32 dt)
+{
+   PROFILE_ZONE("update_collectables");
+
+   Paddle *paddle = &game_state->paddle;
+   Balls *balls = &game_state->balls;
+   Collectables *collectables = &game_state->collectables;
+
+   for (i32 i = 0; i < collectables->num_collectables;)
+   {
+      v2 *c_translate = &collectables->translations[i];
+      c_translate->y -= dt * collectables->fall_speed;
+
+      v2 collectable_paddle_diff = *c_translate - paddle->translate;
+      if (abs(collectable_paddle_diff.x) <= collectables->body_half_width + paddle->body_half_width &&
+          abs(collectable_paddle_diff.y) <= collectables->body_half_height + paddle->body_half_height)
+      {
+         switch (collectables->types[i])
+         {
+            case COLLECTABLE_TYPE_LONG_PADDLE: {
+               paddle->body_half_width = 0.5f * Paddle::LONG_BODY_WIDTH;
+            } break;
+            case COLLECTABLE_TYPE_SHORT_PADDLE: {
+               paddle->body_half_width = 0.5f * Paddle::SHORT_BODY_WIDTH;
+            } break;
+            case COLLECTABLE_TYPE_FAST_BALL: {
+               for (i32 ball_index = 0; ball_index < balls->num_balls; ++ball_index)
+                  balls->speeds[ball_index] = Balls::FAST_SPEED;
+            } break;
+            case COLLECTABLE_TYPE_SLOW_BALL: {
+               for (i32 ball_index = 0; ball_index < balls->num_balls; ++ball_index)
+                  balls->speeds[ball_index] = Balls::SLOW_SPEED;
+            } break;
+            case COLLECTABLE_TYPE_BALL_SPLIT: {
+               split_balls(balls);
+            } break;
+
+            default:
+               assert(false);
+         }
+
+         remove_collectable(collectables, i);
+      }
+      else if (c_translate->y <= -1.0f - collectables->body_half_height - 0.05f)
+         remove_collectable(collectables, i);
+      else
+         ++i;
+   }
+}
+
+// Time of impact of a point moving by `move` from `p` against a box. Returns
+// the fraction of the move in [0, 1] and the axis of the face that was hit.
+// Boxes the point is leaving or already inside of are not reported.
+static bool
+sweep_box(v2 p, v2 move, v2 center, v2 extent, f32 *t, i32 *axis)
+{
+   f32 t_enter = -INFINITY;
+   f32 t_exit = INFINITY;
+   i32 enter_axis = -1;
+
+   for (i32 a = 0; a < 2; ++a)
+   {
+      f32 near = center.p[a] - extent.p[a] - p.p[a];
+      f32 far = center.p[a] + extent.p[a] - p.p[a];
+
+      if (move.p[a] == 0.0f)
+      {
+         if (near > 0.0f || far < 0.0f)
+            return false;
+         continue;
+      }
+
+      f32 t0 = near / move.p[a];
+      f32 t1 = far / move.p[a];
+      if (t0 > t1) swap(t0, t1);
+
+      if (t0 > t_enter)
+      {
+         t_enter = t0;
+         enter_axis = a;
+      }
+      t_exit = min(t_exit, t1);
+   }
+
+   if (enter_axis == -1 || t_enter > t_exit || t_enter < 0.0f || t_enter > 1.0f)
+      return false;
+
+   *t = t_enter;
+   *axis = enter_axis;
+
+   return true;
+}
+
+enum Contact_type
+{
+   CONTACT_TYPE_NONE = 0,
+   CONTACT_TYPE_WALL,
+   CONTACT_TYPE_BLOCK,
+   CONTACT_TYPE_PADDLE,
+};
+
+// Moves the ball for dt, resolving every contact along its path in order of
+// time of impact: walls, blocks and the paddle. Blocks that are hit get
+// destroyed.
+void
+move_ball(Game_state *game_state, i32 ball_index, f32 dt)
+{
+   Paddle *paddle = &game_state->paddle;
+   Balls *balls = &game_state->balls;
+   Level *level = game_state->level;
+
+   v2 translate = V2(balls->translations_x[ball_index], balls->translations_y[ball_index]);
+   v2 velocity = V2(balls->velocities_x[ball_index], balls->velocities_y[ball_index]);
+   f32 speed = balls->speeds[ball_index];
+
+   v2 block_extent = V2(level->block_half_width + balls->half_radius, level->block_half_height + balls->half_radius);
+   v2 paddle_extent = V2(paddle->body_half_width + balls->half_radius, paddle->body_half_height + balls->half_radius);
+
+   f32 time_left = dt;
+
+   for (i32 contact_index = 0; contact_index < Balls::MAX_CONTACTS_PER_STEP; ++contact_index)
+   {
+      v2 move = time_left * speed * velocity;
+
+      Contact_type contact = CONTACT_TYPE_NONE;
+      f32 contact_t = 1.0f;
+      i32 contact_axis = 0;
+      i32 contact_block_index = -1;
+
+      // Walls.
+      if (move.x < 0.0f && translate.x + move.x < -1.0f)
+      {
+         f32 t = (-1.0f - translate.x) / move.x;
+         if (t < contact_t)
+         {
+            contact = CONTACT_TYPE_WALL;
+            contact_t = max(t, 0.0f);
+            contact_axis = 0;
+         }
+      }
+      if (move.x > 0.0f && translate.x + move.x > 1.0f)
+      {
+         f32 t = (1.0f - translate.x) / move.x;
+         if (t < contact_t)
+         {
+            contact = CONTACT_TYPE_WALL;
+            contact_t = max(t, 0.0f);
+            contact_axis = 0;
+         }
+      }
+      if (move.y > 0.0f && translate.y + move.y > 1.0f)
+      {
+         f32 t = (1.0f - translate.y) / move.y;
+         if (t < contact_t)
+         {
+            contact = CONTACT_TYPE_WALL;
+            contact_t = max(t, 0.0f);
+            contact_axis = 1;
+         }
+      }
+
+      // Blocks near the whole path. Normally only the grid cells covered by the
+      // path are visited. When there are only a few live blocks per such cell,
+      // all of them are tested BLOCK_LANES at a time instead, see
+      // BRUTE_FORCE_BLOCKS_PER_CELL.
+      v2 path_min = V2(min(translate.x, translate.x + move.x), min(translate.y, translate.y + move.y));
+      v2 path_max = V2(max(translate.x, translate.x + move.x), max(translate.y, translate.y + move.y));
+      path_min -= block_extent;
+      path_max += block_extent;
+      Cell_range range = cells_overlapping(level, path_min, path_max);
+      i32 num_range_cells = (range.max_row - range.min_row + 1) * (range.max_col - range.min_col + 1);
+
+      if (game_state->num_blocks_left <= BRUTE_FORCE_BLOCKS_PER_CELL * num_range_cells)
+      {
+         for (i32 first = 0; first < game_state->num_blocks_left; first += BLOCK_LANES)
+         {
+            u32 mask = blocks_in_box_mask(level, first, path_min, path_max);
+
+            i32 num_lanes = game_state->num_blocks_left - first;
+            if (num_lanes < BLOCK_LANES)
+               mask &= (1u << num_lanes) - 1;
+
+            for (; mask; mask &= mask-1)
+            {
+               i32 block_index = first + __builtin_ctz(mask);
+               f32 t;
+               i32 axis;
+               // Ties go to the lowest cell, as in the walk below, so that the
+               // choice between the two never changes the game.
+               if (sweep_box(translate, move, block_translation(level, block_index), block_extent, &t, &axis) &&
+                   (t < contact_t ||
+                    (t == contact_t && contact == CONTACT_TYPE_BLOCK &&
+                     level->block_cells[block_index] < level->block_cells[contact_block_index])))
+               {
+                  contact = CONTACT_TYPE_BLOCK;
+                  contact_t = t;
+                  contact_axis = axis;
+                  contact_block_index = block_index;
+               }
+            }
+         }
+      }
+      else
+      {
+         for (i32 row = range.min_row; row <= range.max_row; ++row)
+         {
+            for (i32 col = range.min_col; col <= range.max_col; ++col)
+            {
+               i32 cell = row * level->num_cols + col;
+               if (!is_cell_alive(level, cell))
+                  continue;
+
+               i32 block_index = level->cell_blocks[cell];
+               f32 t;
+               i32 axis;
+               if (sweep_box(translate, move, block_translation(level, block_index), block_extent, &t, &axis) &&
+                   t < contact_t)
+               {
+                  contact = CONTACT_TYPE_BLOCK;
+                  contact_t = t;
+                  contact_axis = axis;
+                  contact_block_index = block_index;
+               }
+            }
+         }
+      }
+
+      // Paddle, only from above.
+      if (translate.y >= paddle->translate.y)
+      {
+         f32 t;
+         i32 axis;
+         if (sweep_box(translate, move, paddle->translate, paddle_extent, &t, &axis) &&
+             t < contact_t)
+         {
+            contact = CONTACT_TYPE_PADDLE;
+            contact_t = t;
+            contact_axis = axis;
+         }
+      }
+
+      translate += contact_t * move;
+      time_left -= contact_t * time_left;
+
+      if (contact == CONTACT_TYPE_NONE)
+         break;
+
+      switch (contact)
+      {
+         case CONTACT_TYPE_NONE: break;
+
+         case CONTACT_TYPE_WALL: {
+            velocity.p[contact_axis] = -velocity.p[contact_axis];
+         } break;
+
+         case CONTACT_TYPE_BLOCK: {
+            velocity.p[contact_axis] = -velocity.p[contact_axis];
+            destroy_block(game_state, contact_block_index);
+         } break;
+
+         case CONTACT_TYPE_PADDLE: {
+            if (contact_axis == 0)
+            {
+               velocity.x = -velocity.x;
+               break;
+            }
+
+            f32 bounce_x = translate.x - paddle->translate.x + paddle->body_half_width;
+
+            i32 segment_index = (i32)(bounce_x / paddle->segment_length);
+            if (segment_index < 0) segment_index = 0;
+            if (segment_index >= paddle->NUM_SEGMENTS) segment_index = paddle->NUM_SEGMENTS-1;
+
+            f32 bounce_angle = paddle->segment_bounce_angles[segment_index];
+            velocity = v2_of_angle(bounce_angle);
+         } break;
+      }
+   }
+
+   balls->translations_x[ball_index] = translate.x;
+   balls->translations_y[ball_index] = translate.y;
+   balls->velocities_x[ball_index] = velocity.x;
+   balls->velocities_y[ball_index] = velocity.y;
+}
+
+void
+resolve_wait_event(Game_state *game_state)
+{
+   PROFILE_ZONE("resolve_wait_event");
+
+   switch (game_state->wait_event)
+   {
+      case WAIT_EVENT_NEXT_LEVEL: {
+         i32 next_level_index = game_state->level_index + 1;
+
+         // Game complete.
+         if (next_level_index == game_state->all_levels_data.num_levels)
+            break;
+
+         ++game_state->lives_left;
+         change_level(game_state, next_level_index);
+      } break;
+
+      case WAIT_EVENT_GAME_OVER: {
+         if (game_state->lives_left-- == 0)
+         {
+            game_state->lives_left = game_state->INITIAL_LIVES;
+            change_level(game_state, game_state->level_index);
+         }
+         else
+         {
+            restart_level_maintaining_destroyed_blocks(game_state);
+         }
+      } break;
+
+      case WAIT_EVENT_NONE: assert(false);
+   }
+}
+
+void
+save_previous_translations(Game_state *game_state)
+{
+   Collectables *collectables = &game_state->collectables;
+
+   game_state->paddle.prev_translate = game_state->paddle.translate;
+   Balls *balls = &game_state->balls;
+   for (i32 i = 0; i < balls->num_balls; ++i)
+   {
+      balls->prev_translations_x[i] = balls->translations_x[i];
+      balls->prev_translations_y[i] = balls->translations_y[i];
+   }
+   for (i32 i = 0; i < collectables->num_collectables; ++i)
+      collectables->prev_translations[i] = collectables->translations[i];
+}
+
+void
+change_level(Game_state *game_state, i32 new_level_index)
+{
+   PROFILE_ZONE("change_level");
+
+   // Restarting keeps the current level, with its blocks in their current
+   // order, the simulation depends on it.
+   All_levels_data *all_levels_data = &game_state->all_levels_data;
+   if (all_levels_data->current->level_index != new_level_index)
+   {
+      i32 state = __atomic_load_n(&all_levels_data->next_state, __ATOMIC_ACQUIRE);
+      if (state != LEVEL_PREFETCH_NONE && all_levels_data->next_level_index == new_level_index)
+      {
+         // Only waits when the prefetch took longer than the whole pause. The
+         // loader may be waiting for this very core, so the wait gives it up.
+         while (state == LEVEL_PREFETCH_LOADING)
+         {
+            sched_yield();
+            state = __atomic_load_n(&all_levels_data->next_state, __ATOMIC_ACQUIRE);
+         }
+
+         swap(all_levels_data->current, all_levels_data->next);
+         all_levels_data->next_state = LEVEL_PREFETCH_NONE;
+      }
+      else
+      {
+         load_level_slot(all_levels_data->current, &all_levels_data->source, new_level_index);
+      }
+   }
+
+   Level *new_level = &all_levels_data->current->level;
+
+   game_state->level_index = new_level_index;
+   game_state->level = new_level;
+   game_state->num_blocks_left = new_level->num_blocks;
+   log_block_change(game_state, BLOCK_CHANGE_ALL);
+
+   for (i32 i = 0; i < new_level->num_blocks; ++i)
+   {
+      i32 cell = new_level->block_cells[i];
+      new_level->alive_cells[cell / 64] |= (u64)1 << (cell % 64);
+   }
+
+   restart_level_maintaining_destroyed_blocks(game_state);
+}
+
+void
+restart_level_maintaining_destroyed_blocks(Game_state *game_state)
+{
+   game_state->started = false;
+   game_state->wait_event = WAIT_EVENT_NONE;
+
+   game_state->paddle.translate = V2(0.0f, -0.86f);
+   game_state->paddle.body_half_width = 0.5f * Paddle::NORMAL_BODY_WIDTH;
+
+   f32 velocity_angle = random_between(&game_state->random_series, 0.25f, 0.75f) * PI32;
+   game_state->balls.num_balls = 0;
+   add_ball(&game_state->balls, V2(0.0f, 0.0f), v2_of_angle(velocity_angle), Balls::NORMAL_SPEED);
+   ball_follow_paddle(&game_state->balls, &game_state->paddle);
+
+   game_state->collectables.num_collectables = 0;
+
+   // Do not interpolate between the old and the restarted positions.
+   save_previous_translations(game_state);
+}
+
+void
+ball_follow_paddle(Balls *balls, Paddle *paddle)
+{
+   assert(balls->num_balls == 1);
+
+   f32 eps = 0.001f;
+   balls->translations_x[0] = paddle->translate.x;
+   balls->translations_y[0] = paddle->translate.y + paddle->body_half_height + balls->half_radius + eps;
+}
+
+void
+reserve_balls(Balls *balls, i32 capacity)
+{
+   if (capacity <= balls->capacity)
+      return;
+
+   Balls old_balls = *balls;
+   place_ball_arrays(balls, (f32 *)malloc(Balls::NUM_ARRAYS * capacity * sizeof(f32)), capacity);
+
+   if (balls->num_balls)
+   {
+      f32 *old_arrays[Balls::NUM_ARRAYS];
+      f32 *new_arrays[Balls::NUM_ARRAYS];
+      ball_arrays(&old_balls, old_arrays);
+      ball_arrays(balls, new_arrays);
+      for (i32 i = 0; i < Balls::NUM_ARRAYS; ++i)
+         memcpy(new_arrays[i], old_arrays[i], balls->num_balls * sizeof(f32));
+   }
+
+   free(old_balls.memory);
+}
+
+bool
+add_ball(Balls *balls, v2 translation, v2 velocity, f32 speed)
+{
+   i32 index = balls->num_balls;
+   if (index == balls->MAX_NUM_BALLS)
+      return false;
+
+   if (index == balls->capacity)
+      reserve_balls(balls, min(2 * balls->capacity, (i32)Balls::MAX_NUM_BALLS));
+
+   balls->translations_x[index] = translation.x;
+   balls->translations_y[index] = translation.y;
+   balls->prev_translations_x[index] = translation.x;
+   balls->prev_translations_y[index] = translation.y;
+   balls->velocities_x[index] = velocity.x;
+   balls->velocities_y[index] = velocity.y;
+   balls->speeds[index] = speed;
+
+   balls->num_balls = index+1;
+
+   return true;
+}
+
+void
+remove_ball(Balls *balls, i32 index)
+{
+   assert(0 <= index && index < balls->num_balls);
+
+   i32 end_index = balls->num_balls-1;
+   swap(balls->translations_x[index], balls->translations_x[end_index]);
+   swap(balls->translations_y[index], balls->translations_y[end_index]);
+   swap(balls->prev_translations_x[index], balls->prev_translations_x[end_index]);
+   swap(balls->prev_translations_y[index], balls->prev_translations_y[end_index]);
+   swap(balls->velocities_x[index], balls->velocities_x[end_index]);
+   swap(balls->velocities_y[index], balls->velocities_y[end_index]);
+   swap(balls->speeds[index], balls->speeds[end_index]);
+
+   balls->num_balls = end_index;
+}
+
+void
+split_balls(Balls *balls)
+{
+   // Every ball in play gets two copies heading off at an angle.
+   f32 cos_angle = cosf(Balls::SPLIT_ANGLE);
+   f32 sin_angle = sinf(Balls::SPLIT_ANGLE);
+
+   i32 num_balls = balls->num_balls;
+   for (i32 i = 0; i < num_balls; ++i)
+   {
+      v2 translation = V2(balls->translations_x[i], balls->translations_y[i]);
+      f32 vx = balls->velocities_x[i];
+      f32 vy = balls->velocities_y[i];
+
+      v2 velocity_left = V2(cos_angle * vx - sin_angle * vy, sin_angle * vx + cos_angle * vy);
+      v2 velocity_right = V2(cos_angle * vx + sin_angle * vy, -sin_angle * vx + cos_angle * vy);
+
+      if (!add_ball(balls, translation, velocity_left, balls->speeds[i]) ||
+          !add_ball(balls, translation, velocity_right, balls->speeds[i]))
+         break;
+   }
+}
+
+void
+set_paddle_width(Paddle *paddle, f32 new_width)
+{
+   paddle->body_half_width = 0.5f * new_width;
+}
+
+void
+destroy_block(Game_state *game_state, i32 block_index)
+{
+   Level *level = game_state->level;
+   assert(0 <= block_index && block_index < game_state->num_blocks_left);
+
+   // Stress levels can drop more collectables than fit, the extra ones are lost.
+   if (level->collectable_types[block_index] != COLLECTABLE_TYPE_NONE &&
+       game_state->collectables.num_collectables < Collectables::MAX_NUM_COLLECTABLES)
+      add_collectable(&game_state->collectables, level->collectable_types[block_index], block_translation(level, block_index));
+
+   i32 cell = level->block_cells[block_index];
+   level->alive_cells[cell / 64] &= ~((u64)1 << (cell % 64));
+
+   i32 end_index = game_state->num_blocks_left-1;
+   swap(level->collectable_types[block_index], level->collectable_types[end_index]);
+   swap(level->translations_x[block_index], level->translations_x[end_index]);
+   swap(level->translations_y[block_index], level->translations_y[end_index]);
+   swap(level->colors[block_index], level->colors[end_index]);
+   swap(level->block_cells[block_index], level->block_cells[end_index]);
+   level->cell_blocks[level->block_cells[block_index]] = block_index;
+   level->cell_blocks[level->block_cells[end_index]] = end_index;
+
+   game_state->num_blocks_left = end_index;
+   log_block_change(game_state, cell);
+}
+
+void
+log_block_change(Game_state *game_state, i32 cell)
+{
+   ++game_state->blocks_version;
+   game_state->block_changes[game_state->blocks_version % BLOCK_CHANGE_LOG_SIZE] = cell;
+}
+
+void
+add_collectable(Collectables *collectables, Collectable_type type, v2 translation)
+{
+   assert(type != COLLECTABLE_TYPE_NONE);
+
+   i32 index = collectables->num_collectables;
+   assert(index < collectables->MAX_NUM_COLLECTABLES);
+
+   collectables->types[index] = type;
+   collectables->translations[index] = translation;
+   collectables->prev_translations[index] = translation;
+   collectables->colors[index] = block_color(type);
+
+   collectables->num_collectables = index+1;
+}
+
+void
+remove_collectable(Collectables *collectables, i32 index)
+{
+   assert(0 <= index && index < collectables->num_collectables);
+
+   i32 end_index = collectables->num_collectables-1;
+   swap(collectables->types[index], collectables->types[end_index]);
+   swap(collectables->translations[index], collectables->translations[end_index]);
+   swap(collectables->prev_translations[index], collectables->prev_translations[end_index]);
+   swap(collectables->colors[index], collectables->colors[end_index]);
+
+   collectables->num_collectables = end_index;
+}
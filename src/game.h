@@ -0,0 +1,401 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "base.h"
+#include "profile.h"
+#include "levels.h"
+#include "colors.h"
+
+// The simulation always advances in steps of SIMULATION_DT, independently of
+// the rate at which frames are rendered. Override with -DSIMULATION_TICK_RATE=N.
+#ifndef SIMULATION_TICK_RATE
+#define SIMULATION_TICK_RATE 240
+#endif
+
+#define SIMULATION_DT (1.0f / SIMULATION_TICK_RATE)
+
+enum Collectable_type
+{
+   COLLECTABLE_TYPE_NONE = 0,
+   COLLECTABLE_TYPE_LONG_PADDLE,
+   COLLECTABLE_TYPE_SHORT_PADDLE,
+   COLLECTABLE_TYPE_FAST_BALL,
+   COLLECTABLE_TYPE_SLOW_BALL,
+   COLLECTABLE_TYPE_BALL_SPLIT,
+};
+
+// Block positions are processed BLOCK_LANES at a time by the SIMD kernels, the
+// position arrays are aligned and padded to a multiple of that.
+#define BLOCK_LANES 8
+#define BLOCK_PADDING_POSITION 1e30f
+
+// move_ball tests all live blocks at once up to this many per cell of its path.
+#define BRUTE_FORCE_BLOCKS_PER_CELL 2
+
+#define BLOCK_CHANGE_LOG_SIZE 256
+#define BLOCK_CHANGE_ALL -1
+
+// Block data of a level lives in one allocation, LEVEL_MEMORY_ALIGNMENT aligned
+// and sized to a multiple of it.
+#define LEVEL_MEMORY_ALIGNMENT (BLOCK_LANES * sizeof(f32))
+
+struct Level
+{
+   size_t memory_size;
+
+   i32 num_rows;
+   i32 num_cols;
+
+   i32 num_blocks;
+   i32 num_padded_blocks;
+   f32 *translations_x;
+   f32 *translations_y;
+   v3 *colors;
+   Collectable_type *collectable_types;
+
+   f32 block_half_width;
+   f32 block_half_height;
+
+   // Uniform grid over the num_rows x num_cols layout of the level text. Block
+   // slots get shuffled when blocks are destroyed, so both directions of the
+   // mapping are kept up to date. A cell's alive bit is set iff it holds a block
+   // that has not been destroyed yet.
+   f32 cell_width;
+   f32 cell_height;
+   i32 *cell_blocks; // Cell -> block slot, -1 for empty cells.
+   i32 *block_cells; // Block slot -> cell.
+   u64 *alive_cells;
+};
+
+struct Cell_range
+{
+   i32 min_row;
+   i32 max_row;
+   i32 min_col;
+   i32 max_col;
+};
+
+// Block data of a level compiled from its text at build time, see
+// level_compiler.h, read from a level pack or generated ahead of time. Loading
+// it is a copy, nothing gets parsed.
+struct Level_table
+{
+   i32 num_rows;
+   i32 num_cols;
+   i32 num_blocks;
+
+   const f32 *translations_x;
+   const f32 *translations_y;
+   const Collectable_type *collectable_types;
+   const i32 *block_cells;
+   const i32 *cell_blocks;
+   const u64 *alive_cells;
+};
+
+// A loaded level and the memory its block data lives in, reused by the next
+// level that fits.
+struct Level_slot
+{
+   Level level;
+   i32 level_index; // -1 when empty.
+
+   void *memory;
+   size_t memory_capacity;
+};
+
+// Where levels are loaded from when they are needed. load puts the level into
+// the slot, see load_level_table_slot. It may be called from the thread that
+// prefetches levels, so it must only read data.
+struct Level_source
+{
+   const void *data;
+   void (*load)(const void *data, i32 level_index, Level_slot *slot);
+};
+
+enum Level_prefetch_state
+{
+   LEVEL_PREFETCH_NONE = 0,
+   LEVEL_PREFETCH_LOADING,
+   LEVEL_PREFETCH_READY,
+};
+
+// Only the level being played is loaded, so neither startup time nor memory
+// depend on the number of levels. The next one can be loaded ahead of time,
+// see claim_level_prefetch, otherwise change_level loads it.
+struct All_levels_data
+{
+   Level_source source;
+   i32 num_levels;
+
+   // Levels that came as texts, parsed once at init. source points at them.
+   Level_table *text_tables;
+   void *text_memory;
+
+   Level_slot *current;
+   Level_slot *next;
+   i32 next_level_index;
+   // Level_prefetch_state, read and written with __atomic builtins.
+   i32 next_state;
+};
+
+struct Paddle
+{
+   v2 translate;
+   // Translation before the last update, used to interpolate rendering.
+   v2 prev_translate;
+   f32 speed;
+
+   static constexpr f32 NORMAL_BODY_WIDTH = 0.2f;
+   static constexpr f32 SHORT_BODY_WIDTH = 0.1f;
+   static constexpr f32 LONG_BODY_WIDTH = 0.4f;
+
+   f32 body_half_width;
+   f32 body_half_height;
+
+   static constexpr i32 NUM_SEGMENTS = 6;
+   f32 segment_length;
+   f32 segment_bounce_angles[NUM_SEGMENTS];
+};
+
+// Pool of balls in play, stored as SoA so that all of them are updated in one
+// pass and drawn with a single instanced draw call. The arrays share one heap
+// allocation that starts small and doubles when it runs out, so that a game
+// with a ball or two stays small while chaos levels can still have thousands.
+struct Balls
+{
+   static constexpr f32 NORMAL_SPEED = 1.6f;
+   static constexpr f32 FAST_SPEED = 1.8f;
+   static constexpr f32 SLOW_SPEED = 1.3f;
+
+   // Contacts resolved in a single step, the rest of the move is dropped.
+   static constexpr i32 MAX_CONTACTS_PER_STEP = 8;
+
+   static const i32 MAX_NUM_BALLS = 4096;
+   static const i32 INITIAL_CAPACITY = 8;
+   static const i32 NUM_ARRAYS = 7;
+   static constexpr f32 SPLIT_ANGLE = PI32 / 6;
+   i32 num_balls;
+   i32 capacity;
+
+   // NUM_ARRAYS arrays of capacity entries each.
+   f32 *memory;
+   f32 *translations_x;
+   f32 *translations_y;
+   f32 *prev_translations_x;
+   f32 *prev_translations_y;
+   f32 *velocities_x;
+   f32 *velocities_y;
+   f32 *speeds;
+
+   f32 radius;
+   f32 half_radius;
+};
+
+struct Collectables
+{
+   static const i32 MAX_NUM_COLLECTABLES = 50;
+   i32 num_collectables;
+
+   Collectable_type types[MAX_NUM_COLLECTABLES];
+   v2 translations[MAX_NUM_COLLECTABLES];
+   v2 prev_translations[MAX_NUM_COLLECTABLES];
+   v3 colors[MAX_NUM_COLLECTABLES];
+
+   f32 fall_speed;
+
+   f32 body_half_width;
+   f32 body_half_height;
+};
+
+enum Wait_event
+{
+   WAIT_EVENT_NONE = 0,
+   WAIT_EVENT_NEXT_LEVEL,
+   WAIT_EVENT_GAME_OVER,
+};
+
+// Buttons held down during a single simulation step. The platform layer fills
+// this from the keyboard, the headless drivers from a bot or a script.
+struct Input
+{
+   bool move_left;
+   bool move_right;
+   bool launch;
+   bool restart;
+   bool pause;
+};
+
+struct Game_state
+{
+   All_levels_data all_levels_data;
+   Paddle          paddle;
+   Balls           balls;
+   Collectables    collectables;
+
+   bool paused;
+   bool pause_was_down;
+   bool started;
+
+   i32 level_index;
+   Level *level;
+   i32 num_blocks_left;
+   // Bumped every time blocks of the current level are destroyed or restored,
+   // so that the renderer knows when to re-upload them. The cell whose alive
+   // bit each bump changed is kept in block_changes[version % BLOCK_CHANGE_LOG_SIZE],
+   // BLOCK_CHANGE_ALL when all of them may have, so that a hit only re-uploads
+   // the bits it touched.
+   u32 blocks_version;
+   i32 block_changes[BLOCK_CHANGE_LOG_SIZE];
+
+   Wait_event wait_event;
+   f32 wait_time_left;
+
+   static const i32 INITIAL_LIVES = 3;
+   i32 lives_left;
+
+   Random_series random_series;
+};
+
+// Snapshot of all the state a game mutates: the Game_state itself, the balls
+// in play and the current level with its block data, whose order changes as
+// blocks get destroyed. Other levels are loaded fresh whenever they are
+// entered.
+// It holds offsets instead of pointers, so it can be copied around freely and
+// restored into any game initialized with the same levels.
+struct Game_snapshot_header
+{
+   u64 num_bytes;
+   u64 state_offset;
+   u64 level_offset;
+   u64 level_memory_offset;
+   u64 level_memory_size;
+   // Balls::NUM_ARRAYS arrays of num_balls entries each.
+   u64 balls_offset;
+};
+
+void
+set_level_layout(Level *level, i32 num_rows, i32 num_cols, i32 num_blocks);
+void
+place_level_arrays(Level *level, void *memory);
+v3
+block_color(Collectable_type type);
+
+bool
+parse_level(Level *level, const char *level_symbols, i32 level_index);
+void
+load_level(Level *level, const char *level_symbols, void *memory);
+void
+load_level_table(Level *level, const Level_table *table, void *memory);
+Level_table
+level_table_of(const Level *level);
+// Grows the slot's memory to at least memory_size bytes, its contents are lost.
+void
+reserve_level_slot(Level_slot *slot, size_t memory_size);
+void
+load_level_table_slot(Level_slot *slot, const Level_table *table, i32 level_index);
+void
+load_level_slot(Level_slot *slot, const Level_source *source, i32 level_index);
+
+// Level text completely filled with blocks, every 16th on average holding a
+// collectable. Free it with free().
+char *
+make_filled_level_text(i32 num_rows, i32 num_cols, Random_series *series);
+// Largest stress level the programs accept.
+#define MAX_STRESS_NUM_BLOCKS (1 << 24)
+// Filled level of at least num_blocks blocks for the stress mode, with its
+// blocks scaled down to fit the screen.
+char *
+make_stress_level_text(i32 num_blocks, Random_series *series);
+
+Cell_range
+cells_overlapping(Level *level, v2 min_corner, v2 max_corner);
+bool
+is_cell_alive(Level *level, i32 cell);
+
+inline v2
+block_translation(Level *level, i32 block_index)
+{
+   return V2(level->translations_x[block_index], level->translations_y[block_index]);
+}
+
+// Plays the levels of levels.h, compiled into tables at build time.
+bool
+game_init(Game_state *game_state, u64 seed);
+// Plays levels from the given source, which has to outlive the game.
+bool
+game_init(Game_state *game_state, u64 seed, Level_source source, i32 level_count);
+// The tables have to outlive the game.
+bool
+game_init(Game_state *game_state, u64 seed, const Level_table *level_tables, i32 level_count);
+// Parses all the given level texts up front, the texts may go away afterwards.
+bool
+game_init(Game_state *game_state, u64 seed, const char **level_texts, i32 level_count);
+void
+init_game_objects(Game_state *game_state);
+// A running prefetch has to be finished first.
+void
+game_free(Game_state *game_state);
+
+// Returns the index of the level to prefetch, which the caller then passes to
+// prefetch_level, usually on another thread, or -1 when there is nothing to do.
+// Levels are prefetched during the WAIT_EVENT_NEXT_LEVEL pause, change_level
+// picks the result up and waits for it if it is still loading. Snapshots must
+// not be taken or restored while a prefetch is running.
+i32
+claim_level_prefetch(Game_state *game_state);
+void
+prefetch_level(All_levels_data *all_levels_data, i32 level_index);
+
+size_t
+game_snapshot_size(const Game_state *game_state);
+void
+game_snapshot(const Game_state *game_state, void *buffer);
+void
+game_restore(Game_state *game_state, const void *buffer);
+
+void
+game_update(Game_state *game_state, const Input &input, f32 dt);
+void
+resolve_wait_event(Game_state *game_state);
+
+void
+update_collectables(Game_state *game_state, f32 dt);
+void
+move_ball(Game_state *game_state, i32 ball_index, f32 dt);
+
+void
+save_previous_translations(Game_state *game_state);
+
+void
+change_level(Game_state *game_state, i32 new_level_index);
+void
+restart_level_maintaining_destroyed_blocks(Game_state *game_state);
+
+void
+ball_follow_paddle(Balls *balls, Paddle *paddle);
+
+// Grows the pool to at least capacity balls, keeping the ones in play.
+void
+reserve_balls(Balls *balls, i32 capacity);
+// Fails when the pool holds MAX_NUM_BALLS already.
+bool
+add_ball(Balls *balls, v2 translation, v2 velocity, f32 speed);
+void
+remove_ball(Balls *balls, i32 index);
+void
+split_balls(Balls *balls);
+
+void
+destroy_block(Game_state *game_state, i32 block_index);
+void
+log_block_change(Game_state *game_state, i32 cell);
+
+void
+add_collectable(Collectables *collectables, Collectable_type type, v2 translation);
+void
+remove_collectable(Collectables *collectables, i32 index);
+
+void
+set_paddle_width(Paddle *paddle, f32 new_width);
+
+#endif
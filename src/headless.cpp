@@ -0,0 +1,219 @@
+#include "game.h"
+#include "game.cpp"
+#include "bot.h"
+#include "replay.cpp"
+#include "level_pack.cpp"
+#include "level_generator.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+// Runs the simulation without a window or a GL context, driven by the bot.
+// Usage: arkanoid_headless [num_ticks] [seed] [--record file] [--pack file | --stress num_blocks | --endless]
+//        arkanoid_headless --play file [--pack file | --stress num_blocks | --endless]
+//
+// --record saves the bot's session as a replay, --play runs a replay (also one
+// recorded by the game) at full speed and checks that it ends in the recorded
+// state. --pack plays the levels of a level pack instead of the built-in ones,
+// --stress a single generated level of at least num_blocks blocks, --endless
+// procedurally generated levels that never run out, see level_generator.h. A
+// replay has to be played with the levels it was recorded with.
+
+static f64
+get_time()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Whole decimal numbers only, so that unknown flags and typos are not taken
+// for one.
+static bool
+parse_number(const char *text, u64 *value)
+{
+   if (*text < '0' || *text > '9')
+      return false;
+
+   char *end;
+   errno = 0;
+   *value = strtoull(text, &end, 10);
+   return *end == 0 && errno == 0;
+}
+
+i32
+main(i32 argc, char **argv)
+{
+   i64 num_ticks = 10000000;
+   u64 seed = 1;
+   const char *record_path = 0;
+   const char *play_path = 0;
+   const char *pack_path = 0;
+   i32 stress_num_blocks = 0;
+   bool endless = false;
+
+   i32 num_positional = 0;
+   u64 number;
+   for (i32 i = 1; i < argc; ++i)
+   {
+      if (strcmp(argv[i], "--record") == 0 && i+1 < argc)
+         record_path = argv[++i];
+      else if (strcmp(argv[i], "--play") == 0 && i+1 < argc)
+         play_path = argv[++i];
+      else if (strcmp(argv[i], "--pack") == 0 && i+1 < argc)
+         pack_path = argv[++i];
+      else if (strcmp(argv[i], "--stress") == 0 && i+1 < argc && parse_number(argv[i+1], &number) &&
+               number > 0 && number <= MAX_STRESS_NUM_BLOCKS)
+      {
+         stress_num_blocks = (i32)number;
+         ++i;
+      }
+      else if (strcmp(argv[i], "--endless") == 0)
+         endless = true;
+      else if (num_positional == 0 && parse_number(argv[i], &number) && number <= INT64_MAX)
+      {
+         num_ticks = (i64)number;
+         ++num_positional;
+      }
+      else if (num_positional == 1 && parse_number(argv[i], &number))
+      {
+         seed = number;
+         ++num_positional;
+      }
+      else
+      {
+         fprintf(stderr, "Usage: %s [num_ticks] [seed] [--record file] | --play file, and --pack file, --stress num_blocks or --endless\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   Replay replay;
+   Replay_player player;
+   if (play_path)
+   {
+      if (!replay_read(&replay, play_path))
+         return EXIT_FAILURE;
+
+      seed = replay.seed;
+      num_ticks = (i64)replay.num_ticks;
+      replay_player_begin(&player, &replay);
+   }
+
+   Level_pack pack = {};
+   defer { if (pack.memory) level_pack_close(&pack); };
+
+   // Levels depend on the seed, so that replays regenerate them.
+   Level_generator generator;
+   generator.params = default_level_generator_params();
+   generator.seed = seed;
+
+   Game_state game_state;
+   if (pack_path)
+   {
+      if (!level_pack_open(&pack, pack_path) ||
+          !game_init(&game_state, seed, &pack))
+         return EXIT_FAILURE;
+   }
+   else if (stress_num_blocks > 0)
+   {
+      // The level depends on the seed too, so that replays regenerate it.
+      Random_series series = random_seed(seed);
+      const char *level_text = make_stress_level_text(stress_num_blocks, &series);
+      defer { free((void *)level_text); };
+
+      if (!game_init(&game_state, seed, &level_text, 1))
+         return EXIT_FAILURE;
+   }
+   else if (endless)
+   {
+      if (!game_init(&game_state, seed, &generator))
+         return EXIT_FAILURE;
+   }
+   else if (!game_init(&game_state, seed))
+      return EXIT_FAILURE;
+
+   Replay_levels levels;
+   if (pack_path) levels = replay_levels_of_pack(&pack);
+   else if (stress_num_blocks > 0) levels = replay_levels_of_stress(stress_num_blocks);
+   else if (endless) levels = replay_levels_of_generator(&generator.params);
+   else levels = replay_levels_built_in();
+
+   if (play_path && !replay_check_levels(&replay, &levels, play_path))
+      return EXIT_FAILURE;
+   if (record_path)
+      replay_begin(&replay, seed, &levels);
+
+   i32 levels_cleared = 0;
+   i32 last_level_index = game_state.level_index;
+
+   f64 begin_time = get_time();
+
+   for (i64 tick = 0; tick < num_ticks; ++tick)
+   {
+      Input input;
+      if (play_path)
+      {
+         if (!replay_next_input(&player, &input))
+         {
+            fprintf(stderr, "Replay ended early at tick %lld.\n", (long long)tick);
+            num_ticks = tick;
+            break;
+         }
+      }
+      else
+      {
+         input = bot_input(&game_state, (u32)tick);
+         if (record_path)
+            replay_record(&replay, input);
+      }
+
+      game_update(&game_state, input, SIMULATION_DT);
+
+      if (game_state.level_index != last_level_index)
+      {
+         ++levels_cleared;
+         last_level_index = game_state.level_index;
+      }
+   }
+
+   f64 elapsed = get_time() - begin_time;
+
+   printf("Simulated %lld ticks in %.3fs (%.0f ticks/s).\n", (long long)num_ticks, elapsed, num_ticks / elapsed);
+   printf("Level %d of %d, %d blocks left, %d lives left, %d level changes.\n",
+         game_state.level_index+1,
+         game_state.all_levels_data.num_levels,
+         game_state.num_blocks_left,
+         game_state.lives_left,
+         levels_cleared);
+
+   i32 result = EXIT_SUCCESS;
+
+   if (play_path)
+   {
+      if (replay_check_final_state(&replay, &game_state))
+         printf("Replay '%s' reproduced the recorded final state.\n", play_path);
+      else
+      {
+         printf("Replay '%s' desynced, final state differs from the recorded one.\n", play_path);
+         result = EXIT_FAILURE;
+      }
+      replay_free(&replay);
+   }
+   else if (record_path)
+   {
+      replay_end(&replay, &game_state);
+      if (replay_write(&replay, record_path))
+         printf("Recorded %lld ticks into '%s' (%d bytes of input).\n", (long long)replay.num_ticks, record_path, replay.runs.length);
+      else
+         result = EXIT_FAILURE;
+      replay_free(&replay);
+   }
+
+   game_free(&game_state);
+   profile_write_trace("arkanoid_headless_trace.json");
+
+   return result;
+}
@@ -0,0 +1,215 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// base.h defines min, max and swap as macros, which break the standard headers.
+#pragma push_macro("min")
+#pragma push_macro("max")
+#pragma push_macro("swap")
+#undef min
+#undef max
+#undef swap
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#pragma pop_macro("swap")
+#pragma pop_macro("max")
+#pragma pop_macro("min")
+
+// Pool of persistent worker threads running batches of independent jobs.
+// Every worker owns a range of job indices. It takes jobs from the front of its
+// own range and, when that runs dry, steals the back half of the range of
+// another worker. A range is a single 64-bit word updated with CAS, so neither
+// side ever takes a lock while jobs are running.
+
+typedef void Job_function(void *data, i32 job_index, i32 worker_index);
+
+struct alignas(64) Job_range
+{
+   // Low 32 bits are the first job, high 32 bits one past the last job.
+   std::atomic<u64> begin_end;
+};
+
+struct Job_pool
+{
+   i32 num_workers;
+   std::thread *threads;
+   Job_range *ranges;
+
+   Job_function *function;
+   void *data;
+
+   std::mutex mutex;
+   std::condition_variable start_condition;
+   std::condition_variable done_condition;
+   u64 generation;
+   i32 num_workers_running;
+   bool quit;
+};
+
+inline u64
+pack_job_range(u32 begin, u32 end)
+{
+   return (u64)end << 32 | begin;
+}
+
+inline bool
+pop_job(Job_range *range, i32 *job_index)
+{
+   u64 old_value = range->begin_end.load(std::memory_order_relaxed);
+   for (;;)
+   {
+      u32 begin = (u32)old_value;
+      u32 end = (u32)(old_value >> 32);
+      if (begin >= end)
+         return false;
+
+      if (range->begin_end.compare_exchange_weak(old_value, pack_job_range(begin+1, end), std::memory_order_acq_rel))
+      {
+         *job_index = (i32)begin;
+         return true;
+      }
+   }
+}
+
+// Moves the back half of the victim's range into the thief's (empty) range.
+inline bool
+steal_jobs(Job_range *victim, Job_range *thief)
+{
+   u64 old_value = victim->begin_end.load(std::memory_order_relaxed);
+   for (;;)
+   {
+      u32 begin = (u32)old_value;
+      u32 end = (u32)(old_value >> 32);
+      if (begin >= end)
+         return false;
+
+      u32 middle = end - (end - begin + 1) / 2;
+      if (victim->begin_end.compare_exchange_weak(old_value, pack_job_range(begin, middle), std::memory_order_acq_rel))
+      {
+         thief->begin_end.store(pack_job_range(middle, end), std::memory_order_release);
+         return true;
+      }
+   }
+}
+
+inline void
+work_on_jobs(Job_pool *pool, i32 worker_index)
+{
+   Job_range *own_range = &pool->ranges[worker_index];
+
+   for (;;)
+   {
+      i32 job_index;
+      while (pop_job(own_range, &job_index))
+         pool->function(pool->data, job_index, worker_index);
+
+      bool stole = false;
+      for (i32 i = 1; i < pool->num_workers && !stole; ++i)
+      {
+         i32 victim_index = (worker_index + i) % pool->num_workers;
+         stole = steal_jobs(&pool->ranges[victim_index], own_range);
+      }
+
+      if (!stole)
+         return;
+   }
+}
+
+inline void
+job_worker_main(Job_pool *pool, i32 worker_index)
+{
+   u64 seen_generation = 0;
+
+   for (;;)
+   {
+      {
+         std::unique_lock<std::mutex> lock(pool->mutex);
+         pool->start_condition.wait(lock, [&]() { return pool->quit || pool->generation != seen_generation; });
+         if (pool->quit)
+            return;
+         seen_generation = pool->generation;
+      }
+
+      work_on_jobs(pool, worker_index);
+
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      if (--pool->num_workers_running == 0)
+         pool->done_condition.notify_one();
+   }
+}
+
+// num_workers counts the calling thread, 0 picks one per hardware thread.
+inline Job_pool *
+job_pool_create(i32 num_workers = 0)
+{
+   if (num_workers <= 0)
+      num_workers = (i32)std::thread::hardware_concurrency();
+   if (num_workers <= 0)
+      num_workers = 1;
+
+   Job_pool *pool = new Job_pool;
+   pool->num_workers = num_workers;
+   pool->ranges = new Job_range[num_workers];
+   for (i32 i = 0; i < num_workers; ++i)
+      pool->ranges[i].begin_end.store(0);
+   pool->function = 0;
+   pool->data = 0;
+   pool->generation = 0;
+   pool->num_workers_running = 0;
+   pool->quit = false;
+
+   pool->threads = new std::thread[num_workers];
+   for (i32 i = 1; i < num_workers; ++i)
+      pool->threads[i] = std::thread(job_worker_main, pool, i);
+
+   return pool;
+}
+
+inline void
+job_pool_destroy(Job_pool *pool)
+{
+   {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->quit = true;
+   }
+   pool->start_condition.notify_all();
+
+   for (i32 i = 1; i < pool->num_workers; ++i)
+      pool->threads[i].join();
+
+   delete[] pool->threads;
+   delete[] pool->ranges;
+   delete pool;
+}
+
+// Runs function(data, job_index, worker_index) for every job index in
+// [0, num_jobs) and returns once all of them are done. Jobs must not touch
+// each other's data; worker_index can be used to pick per-worker scratch.
+inline void
+job_pool_run(Job_pool *pool, i32 num_jobs, Job_function *function, void *data)
+{
+   i32 num_workers = pool->num_workers;
+   for (i32 i = 0; i < num_workers; ++i)
+   {
+      u32 begin = (u32)((i64)num_jobs * i / num_workers);
+      u32 end = (u32)((i64)num_jobs * (i+1) / num_workers);
+      pool->ranges[i].begin_end.store(pack_job_range(begin, end), std::memory_order_relaxed);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      pool->function = function;
+      pool->data = data;
+      pool->num_workers_running = num_workers-1;
+      ++pool->generation;
+   }
+   pool->start_condition.notify_all();
+
+   work_on_jobs(pool, 0);
+
+   std::unique_lock<std::mutex> lock(pool->mutex);
+   pool->done_condition.wait(lock, [&]() { return pool->num_workers_running == 0; });
+}
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef LEVEL_COMPILER_H
+#define LEVEL_COMPILER_H
+
+#include "game.h"
+
+// Level text parsing. Everything here is constexpr: the levels of levels.h are
+// turned into Level_tables while the game compiles, malformed ones failing one
+// of the static_asserts in COMPILE_LEVEL, and parse_level/load_level run the
+// very same code at runtime for texts that are not known in advance.
+
+enum Level_text_error
+{
+   LEVEL_TEXT_ERROR_NONE = 0,
+   LEVEL_TEXT_ERROR_UNKNOWN_SYMBOL,
+   LEVEL_TEXT_ERROR_INCONSISTENT_COLUMNS,
+   LEVEL_TEXT_ERROR_MISSING_NEWLINE,
+};
+
+struct Level_text_size
+{
+   i32 num_rows;
+   i32 num_cols;
+   i32 num_blocks;
+
+   Level_text_error error;
+   // Where the error is, for the runtime messages.
+   i32 error_row;
+   i32 error_num_cols;
+   char error_symbol;
+};
+
+constexpr f32 LEVEL_BLOCK_HEIGHT = 0.05f;
+constexpr f32 LEVEL_BETWEEN_BLOCKS_PADDING = 0.01f;
+
+// Levels up to this size get full size blocks and padding. Bigger ones, like
+// the stress levels, are scaled down to fit the same area.
+constexpr i32 LEVEL_FULL_SIZE_COLS = 20;
+constexpr i32 LEVEL_FULL_SIZE_ROWS = 27;
+
+constexpr f32
+level_padding_x(i32 num_cols)
+{
+   if (num_cols <= LEVEL_FULL_SIZE_COLS)
+      return LEVEL_BETWEEN_BLOCKS_PADDING;
+   return LEVEL_FULL_SIZE_COLS * LEVEL_BETWEEN_BLOCKS_PADDING / num_cols;
+}
+
+constexpr f32
+level_padding_y(i32 num_rows)
+{
+   if (num_rows <= LEVEL_FULL_SIZE_ROWS)
+      return LEVEL_BETWEEN_BLOCKS_PADDING;
+   return LEVEL_FULL_SIZE_ROWS * LEVEL_BETWEEN_BLOCKS_PADDING / num_rows;
+}
+
+constexpr f32
+level_block_width(i32 num_cols)
+{
+   f32 screen_width = 2.0f;
+   return (screen_width - (num_cols-1) * level_padding_x(num_cols)) / num_cols;
+}
+
+constexpr f32
+level_block_height(i32 num_rows)
+{
+   if (num_rows <= LEVEL_FULL_SIZE_ROWS)
+      return LEVEL_BLOCK_HEIGHT;
+   return LEVEL_FULL_SIZE_ROWS * LEVEL_BLOCK_HEIGHT / num_rows;
+}
+
+// Center of the block in the given cell, shared by everything that lays out
+// levels so that their blocks land on exactly the same positions.
+constexpr f32
+level_block_x(i32 col, f32 block_width, f32 padding_x)
+{
+   return -1.0f + (col + 0.5f) * block_width + col * padding_x;
+}
+
+constexpr f32
+level_block_y(i32 row, f32 block_height, f32 padding_y)
+{
+   return 1.0f - (row + 0.5f) * block_height - row * padding_y;
+}
+
+constexpr bool
+is_block_symbol(char symbol)
+{
+   return symbol == BOARD_SYMBOL_BLOCK_NORMAL ||
+          symbol == BOARD_SYMBOL_BLOCK_LONG_PADDLE ||
+          symbol == BOARD_SYMBOL_BLOCK_SHORT_PADDLE ||
+          symbol == BOARD_SYMBOL_BLOCK_FAST_BALL ||
+          symbol == BOARD_SYMBOL_BLOCK_SLOW_BALL ||
+          symbol == BOARD_SYMBOL_BLOCK_BALL_SPLIT;
+}
+
+constexpr Collectable_type
+block_symbol_collectable_type(char symbol)
+{
+   switch (symbol)
+   {
+      case BOARD_SYMBOL_BLOCK_LONG_PADDLE: return COLLECTABLE_TYPE_LONG_PADDLE;
+      case BOARD_SYMBOL_BLOCK_SHORT_PADDLE: return COLLECTABLE_TYPE_SHORT_PADDLE;
+      case BOARD_SYMBOL_BLOCK_FAST_BALL: return COLLECTABLE_TYPE_FAST_BALL;
+      case BOARD_SYMBOL_BLOCK_SLOW_BALL: return COLLECTABLE_TYPE_SLOW_BALL;
+      case BOARD_SYMBOL_BLOCK_BALL_SPLIT: return COLLECTABLE_TYPE_BALL_SPLIT;
+      default: return COLLECTABLE_TYPE_NONE;
+   }
+}
+
+// First pass, counts rows, columns and blocks and validates the text.
+constexpr Level_text_size
+measure_level_text(const char *level_symbols)
+{
+   Level_text_size size = {};
+   i32 num_cols = 0;
+
+   // Allow that so that board is more readable.
+   if (level_symbols[0] == BOARD_SYMBOL_NEW_ROW)
+      ++level_symbols;
+
+   for (i32 index = 0; level_symbols[index]; ++index)
+   {
+      char symbol = level_symbols[index];
+
+      if (symbol == BOARD_SYMBOL_NEW_ROW)
+      {
+         if (!size.num_cols)
+            size.num_cols = num_cols;
+         else if (num_cols != size.num_cols)
+         {
+            size.error = LEVEL_TEXT_ERROR_INCONSISTENT_COLUMNS;
+            size.error_row = size.num_rows;
+            size.error_num_cols = num_cols;
+            return size;
+         }
+
+         ++size.num_rows;
+         num_cols = 0;
+      }
+      else if (is_block_symbol(symbol))
+      {
+         ++size.num_blocks;
+         ++num_cols;
+      }
+      else if (symbol == BOARD_SYMBOL_EMPTY)
+      {
+         ++num_cols;
+      }
+      else
+      {
+         size.error = LEVEL_TEXT_ERROR_UNKNOWN_SYMBOL;
+         size.error_row = size.num_rows;
+         size.error_symbol = symbol;
+         return size;
+      }
+   }
+
+   if (num_cols)
+   {
+      size.error = LEVEL_TEXT_ERROR_MISSING_NEWLINE;
+      size.error_row = size.num_rows;
+   }
+
+   return size;
+}
+
+// Second pass over a text that measure_level_text accepted. Blocks are stored
+// in text order, cell_blocks gets -1 for empty cells.
+constexpr void
+fill_level_blocks(const char *level_symbols, i32 num_rows, i32 num_cols,
+                  f32 *translations_x, f32 *translations_y, Collectable_type *collectable_types,
+                  i32 *block_cells, i32 *cell_blocks, u64 *alive_cells)
+{
+   if (level_symbols[0] == BOARD_SYMBOL_NEW_ROW)
+      ++level_symbols;
+
+   i32 num_cells = num_rows * num_cols;
+   for (i32 cell = 0; cell < num_cells; ++cell)
+      cell_blocks[cell] = -1;
+   for (i32 word = 0; word < (num_cells + 63) / 64; ++word)
+      alive_cells[word] = 0;
+
+   f32 block_width = level_block_width(num_cols);
+   f32 block_height = level_block_height(num_rows);
+   f32 padding_x = level_padding_x(num_cols);
+   f32 padding_y = level_padding_y(num_rows);
+
+   i32 index = 0;
+   i32 block_index = 0;
+
+   for (i32 row = 0; row < num_rows; ++row)
+   {
+      for (i32 col = 0; col < num_cols+1; ++col)
+      {
+         char symbol = level_symbols[index++];
+         if (!is_block_symbol(symbol))
+            continue;
+
+         translations_x[block_index] = level_block_x(col, block_width, padding_x);
+         translations_y[block_index] = level_block_y(row, block_height, padding_y);
+         collectable_types[block_index] = block_symbol_collectable_type(symbol);
+
+         i32 cell = row * num_cols + col;
+         block_cells[block_index] = cell;
+         cell_blocks[cell] = block_index;
+         alive_cells[cell / 64] |= (u64)1 << (cell % 64);
+
+         ++block_index;
+      }
+   }
+}
+
+// Block arrays of a level whose size is known at compile time. They have one
+// extra element so that levels without blocks still compile.
+template<i32 NUM_ROWS, i32 NUM_COLS, i32 NUM_BLOCKS>
+struct Compiled_level
+{
+   static constexpr i32 NUM_CELLS = NUM_ROWS * NUM_COLS;
+   static constexpr i32 NUM_ALIVE_WORDS = (NUM_CELLS + 63) / 64;
+
+   f32 translations_x[NUM_BLOCKS+1];
+   f32 translations_y[NUM_BLOCKS+1];
+   Collectable_type collectable_types[NUM_BLOCKS+1];
+   i32 block_cells[NUM_BLOCKS+1];
+   i32 cell_blocks[NUM_CELLS+1];
+   u64 alive_cells[NUM_ALIVE_WORDS+1];
+};
+
+template<i32 NUM_ROWS, i32 NUM_COLS, i32 NUM_BLOCKS>
+constexpr Compiled_level<NUM_ROWS, NUM_COLS, NUM_BLOCKS>
+compile_level_text(const char *level_symbols)
+{
+   Compiled_level<NUM_ROWS, NUM_COLS, NUM_BLOCKS> level = {};
+
+   // The static_asserts report errors, do not pile more on top of them.
+   if (measure_level_text(level_symbols).error != LEVEL_TEXT_ERROR_NONE)
+      return level;
+
+   fill_level_blocks(level_symbols, NUM_ROWS, NUM_COLS,
+         level.translations_x, level.translations_y, level.collectable_types,
+         level.block_cells, level.cell_blocks, level.alive_cells);
+
+   return level;
+}
+
+template<i32 NUM_ROWS, i32 NUM_COLS, i32 NUM_BLOCKS>
+constexpr Level_table
+level_table(const Compiled_level<NUM_ROWS, NUM_COLS, NUM_BLOCKS> &level)
+{
+   Level_table table = {};
+   table.num_rows = NUM_ROWS;
+   table.num_cols = NUM_COLS;
+   table.num_blocks = NUM_BLOCKS;
+   table.translations_x = level.translations_x;
+   table.translations_y = level.translations_y;
+   table.collectable_types = level.collectable_types;
+   table.block_cells = level.block_cells;
+   table.cell_blocks = level.cell_blocks;
+   table.alive_cells = level.alive_cells;
+
+   return table;
+}
+
+#define COMPILE_LEVEL(level) \
+   constexpr Level_text_size level##_size = measure_level_text(level); \
+   static_assert(level##_size.error != LEVEL_TEXT_ERROR_UNKNOWN_SYMBOL, "Unknown character in " #level " text."); \
+   static_assert(level##_size.error != LEVEL_TEXT_ERROR_INCONSISTENT_COLUMNS, "Inconsistent number of columns in " #level " text."); \
+   static_assert(level##_size.error != LEVEL_TEXT_ERROR_MISSING_NEWLINE, "Expected newline at the end of " #level " text."); \
+   constexpr auto compiled_##level = compile_level_text<level##_size.num_rows, level##_size.num_cols, level##_size.num_blocks>(level);
+
+ALL_LEVELS(COMPILE_LEVEL)
+
+#define LEVEL_TABLE(level) level_table(compiled_##level),
+constexpr Level_table all_level_tables[] = {
+   ALL_LEVELS(LEVEL_TABLE)
+};
+#undef LEVEL_TABLE
+
+constexpr i32 num_level_tables = sizeof(all_level_tables) / sizeof(all_level_tables[0]);
+
+#endif
@@ -0,0 +1,306 @@
+#include "level_generator.h"
+#include "level_compiler.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Chances of a level's cells, derived once from the parameters.
+struct Cell_chances
+{
+   f32 density;
+   // Cumulative type weights, a cell gets the first type whose threshold is
+   // above its roll.
+   f32 type_thresholds[NUM_COLLECTABLE_TYPES];
+   Collectable_type last_type;
+};
+
+Level_generator_params
+default_level_generator_params()
+{
+   Level_generator_params params;
+   params.num_rows = 12;
+   params.num_cols = 13;
+   params.density = 0.55f;
+   params.symmetry = LEVEL_SYMMETRY_MIRROR_X;
+
+   // About one block in five drops a collectable.
+   params.type_weights[COLLECTABLE_TYPE_NONE] = 20.0f;
+   params.type_weights[COLLECTABLE_TYPE_LONG_PADDLE] = 1.0f;
+   params.type_weights[COLLECTABLE_TYPE_SHORT_PADDLE] = 1.0f;
+   params.type_weights[COLLECTABLE_TYPE_FAST_BALL] = 1.0f;
+   params.type_weights[COLLECTABLE_TYPE_SLOW_BALL] = 1.0f;
+   params.type_weights[COLLECTABLE_TYPE_BALL_SPLIT] = 1.0f;
+
+   return params;
+}
+
+bool
+check_level_generator_params(const Level_generator_params *params)
+{
+   if (params->num_rows <= 0 || params->num_cols <= 0 ||
+       (i64)params->num_rows * params->num_cols > INT32_MAX / 4)
+   {
+      fprintf(stderr, "Generated levels cannot be %d x %d cells.\n", params->num_rows, params->num_cols);
+      return false;
+   }
+
+   if (!(params->density >= 0.0f && params->density <= 1.0f))
+   {
+      fprintf(stderr, "Generated level density %f is not between 0 and 1.\n", params->density);
+      return false;
+   }
+
+   f32 total_weight = 0.0f;
+   for (i32 type = 0; type < NUM_COLLECTABLE_TYPES; ++type)
+   {
+      if (!(params->type_weights[type] >= 0.0f))
+      {
+         fprintf(stderr, "Generated level block weights cannot be negative.\n");
+         return false;
+      }
+      total_weight += params->type_weights[type];
+   }
+
+   if (total_weight <= 0.0f)
+   {
+      fprintf(stderr, "Generated level block weights add up to zero.\n");
+      return false;
+   }
+
+   return true;
+}
+
+u64
+generated_level_seed(u64 seed, i32 level_index)
+{
+   u64 x = seed + (u64)level_index * 0xd1b54a32d192ed03ull;
+   return splitmix64(&x);
+}
+
+static Cell_chances
+cell_chances(const Level_generator_params *params)
+{
+   Cell_chances chances;
+   chances.density = params->density;
+   chances.last_type = COLLECTABLE_TYPE_NONE;
+
+   f32 total_weight = 0.0f;
+   for (i32 type = 0; type < NUM_COLLECTABLE_TYPES; ++type)
+   {
+      total_weight += params->type_weights[type];
+      chances.type_thresholds[type] = total_weight;
+      if (params->type_weights[type] > 0.0f)
+         chances.last_type = (Collectable_type)type;
+   }
+
+   for (i32 type = 0; type < NUM_COLLECTABLE_TYPES; ++type)
+      chances.type_thresholds[type] /= total_weight;
+
+   return chances;
+}
+
+// The cell whose hash decides this one.
+static i32
+symmetry_source_cell(const Level_generator_params *params, i32 row, i32 col)
+{
+   if (params->symmetry != LEVEL_SYMMETRY_NONE)
+      col = min(col, params->num_cols-1 - col);
+   if (params->symmetry == LEVEL_SYMMETRY_MIRROR_XY)
+      row = min(row, params->num_rows-1 - row);
+
+   return row * params->num_cols + col;
+}
+
+// Two independent 24 bit rolls per cell, the top bits say whether it holds a
+// block and the ones below what type the block is.
+static u64
+generated_cell_hash(u64 level_seed, i32 source_cell)
+{
+   u64 x = level_seed ^ ((u64)source_cell * 0x9e3779b97f4a7c15ull);
+   return splitmix64(&x);
+}
+
+// Both are branchless, the rolls are random so branches on them would
+// mispredict about every other cell.
+static bool
+generated_cell_has_block(const Cell_chances *chances, u64 hash)
+{
+   return (hash >> 40) * (1.0f / 16777216.0f) < chances->density;
+}
+
+static Collectable_type
+generated_cell_type(const Cell_chances *chances, u64 hash)
+{
+   f32 roll = ((hash >> 16) & 0xffffff) * (1.0f / 16777216.0f);
+
+   i32 type = 0;
+   for (i32 i = 0; i < NUM_COLLECTABLE_TYPES-1; ++i)
+      type += roll >= chances->type_thresholds[i];
+
+   // Rounding can leave the roll above the last threshold with weight.
+   return (Collectable_type)min(type, (i32)chances->last_type);
+}
+
+void
+measure_generated_level(Level *level, const Level_generator_params *params, u64 level_seed)
+{
+   PROFILE_ZONE("measure_generated_level");
+
+   Cell_chances chances = cell_chances(params);
+
+   i32 num_blocks = 0;
+   for (i32 row = 0; row < params->num_rows; ++row)
+   {
+      for (i32 col = 0; col < params->num_cols; ++col)
+      {
+         u64 hash = generated_cell_hash(level_seed, symmetry_source_cell(params, row, col));
+         num_blocks += generated_cell_has_block(&chances, hash);
+      }
+   }
+
+   set_level_layout(level, params->num_rows, params->num_cols, num_blocks);
+}
+
+void
+generate_level(Level *level, const Level_generator_params *params, u64 level_seed, void *memory)
+{
+   PROFILE_ZONE("generate_level");
+
+   place_level_arrays(level, memory);
+
+   i32 num_rows = level->num_rows;
+   i32 num_cols = level->num_cols;
+   i32 num_cells = num_rows * num_cols;
+   for (i32 cell = 0; cell < num_cells; ++cell)
+      level->cell_blocks[cell] = -1;
+   for (i32 word = 0; word < (num_cells + 63) / 64; ++word)
+      level->alive_cells[word] = 0;
+
+   f32 block_width = level_block_width(num_cols);
+   f32 block_height = level_block_height(num_rows);
+   f32 padding_x = level_padding_x(num_cols);
+   f32 padding_y = level_padding_y(num_rows);
+
+   Cell_chances chances = cell_chances(params);
+   i32 block_index = 0;
+
+   for (i32 row = 0; row < num_rows; ++row)
+   {
+      for (i32 col = 0; col < num_cols; ++col)
+      {
+         u64 hash = generated_cell_hash(level_seed, symmetry_source_cell(params, row, col));
+         if (!generated_cell_has_block(&chances, hash))
+            continue;
+
+         Collectable_type type = generated_cell_type(&chances, hash);
+         level->translations_x[block_index] = level_block_x(col, block_width, padding_x);
+         level->translations_y[block_index] = level_block_y(row, block_height, padding_y);
+         level->collectable_types[block_index] = type;
+         level->colors[block_index] = block_color(type);
+
+         i32 cell = row * num_cols + col;
+         level->block_cells[block_index] = cell;
+         level->cell_blocks[cell] = block_index;
+         level->alive_cells[cell / 64] |= (u64)1 << (cell % 64);
+
+         ++block_index;
+      }
+   }
+
+   assert(block_index == level->num_blocks);
+}
+
+struct Generate_levels_job
+{
+   const Level_generator *generator;
+   Level *levels;
+   size_t *memory_offsets;
+   Generated_levels *result;
+};
+
+static void
+measure_generated_level_job(void *data, i32 level_index, i32)
+{
+   Generate_levels_job *job = (Generate_levels_job *)data;
+   u64 level_seed = generated_level_seed(job->generator->seed, level_index);
+
+   measure_generated_level(&job->levels[level_index], &job->generator->params, level_seed);
+}
+
+static void
+generate_level_job(void *data, i32 level_index, i32)
+{
+   Generate_levels_job *job = (Generate_levels_job *)data;
+   u64 level_seed = generated_level_seed(job->generator->seed, level_index);
+
+   Level *level = &job->levels[level_index];
+   void *memory = (u8 *)job->result->memory + job->memory_offsets[level_index];
+   generate_level(level, &job->generator->params, level_seed, memory);
+   job->result->tables[level_index] = level_table_of(level);
+}
+
+void
+generate_levels(Generated_levels *levels, const Level_generator *generator, i32 level_count, Job_pool *pool)
+{
+   PROFILE_ZONE("generate_levels");
+
+   Generate_levels_job job;
+   job.generator = generator;
+   job.levels = (Level *)malloc(level_count * sizeof(Level));
+   job.memory_offsets = (size_t *)malloc(level_count * sizeof(size_t));
+   job.result = levels;
+   defer { free(job.levels); free(job.memory_offsets); };
+
+   job_pool_run(pool, level_count, measure_generated_level_job, &job);
+
+   // Every memory_size is a multiple of LEVEL_MEMORY_ALIGNMENT, so all levels
+   // stay aligned when packed back to back.
+   size_t memory_size = 0;
+   for (i32 level_index = 0; level_index < level_count; ++level_index)
+   {
+      job.memory_offsets[level_index] = memory_size;
+      memory_size += job.levels[level_index].memory_size;
+   }
+
+   levels->num_levels = level_count;
+   levels->tables = (Level_table *)malloc(max(level_count, 1) * sizeof(Level_table));
+   levels->memory = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, max(memory_size, LEVEL_MEMORY_ALIGNMENT));
+
+   job_pool_run(pool, level_count, generate_level_job, &job);
+}
+
+void
+free_generated_levels(Generated_levels *levels)
+{
+   free(levels->tables);
+   free(levels->memory);
+   levels->num_levels = 0;
+   levels->tables = 0;
+   levels->memory = 0;
+}
+
+static void
+load_generated_level(const void *data, i32 level_index, Level_slot *slot)
+{
+   const Level_generator *generator = (const Level_generator *)data;
+   u64 level_seed = generated_level_seed(generator->seed, level_index);
+
+   measure_generated_level(&slot->level, &generator->params, level_seed);
+   reserve_level_slot(slot, max(slot->level.memory_size, LEVEL_MEMORY_ALIGNMENT));
+   generate_level(&slot->level, &generator->params, level_seed, slot->memory);
+   slot->level_index = level_index;
+}
+
+bool
+game_init(Game_state *game_state, u64 seed, const Level_generator *generator)
+{
+   if (!check_level_generator_params(&generator->params))
+      return false;
+
+   Level_source source;
+   source.data = generator;
+   source.load = load_generated_level;
+
+   return game_init(game_state, seed, source, ENDLESS_NUM_LEVELS);
+}
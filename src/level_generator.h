@@ -0,0 +1,82 @@
+#ifndef LEVEL_GENERATOR_H
+#define LEVEL_GENERATOR_H
+
+#include "game.h"
+
+struct Job_pool;
+
+// Procedural levels, generated straight into the Level form without going
+// through a text. Every cell is decided by a hash of the level seed and the
+// cell alone, so a level depends only on its seed and parameters, mirrored
+// cells share the hash of the cell they mirror and any number of levels can be
+// generated in parallel. Blocks are laid out exactly like parsed ones, in text
+// order, so a generated level plays the same as its text would.
+
+#define NUM_COLLECTABLE_TYPES (COLLECTABLE_TYPE_BALL_SPLIT+1)
+
+enum Level_symmetry
+{
+   LEVEL_SYMMETRY_NONE = 0,
+   LEVEL_SYMMETRY_MIRROR_X,  // Left half mirrored into the right one.
+   LEVEL_SYMMETRY_MIRROR_XY, // Top left quarter mirrored into the other three.
+};
+
+struct Level_generator_params
+{
+   i32 num_rows;
+   i32 num_cols;
+   // Chance of a cell holding a block.
+   f32 density;
+   Level_symmetry symmetry;
+   // Relative weights of the kinds of blocks, indexed by Collectable_type.
+   // COLLECTABLE_TYPE_NONE is the plain block.
+   f32 type_weights[NUM_COLLECTABLE_TYPES];
+};
+
+// Level i of a generator is generated from generated_level_seed(seed, i).
+struct Level_generator
+{
+   Level_generator_params params;
+   u64 seed;
+};
+
+// Levels generated ahead of time, their tables point into memory.
+struct Generated_levels
+{
+   i32 num_levels;
+   Level_table *tables;
+   void *memory;
+};
+
+// Endless mode has as many levels as a level index can count.
+#define ENDLESS_NUM_LEVELS INT32_MAX
+
+Level_generator_params
+default_level_generator_params();
+// Reports what is wrong with the parameters.
+bool
+check_level_generator_params(const Level_generator_params *params);
+
+u64
+generated_level_seed(u64 seed, i32 level_index);
+
+// Same split as parse_level and load_level: the first one counts the blocks and
+// sets the layout, the second one fills level->memory_size bytes of memory.
+void
+measure_generated_level(Level *level, const Level_generator_params *params, u64 level_seed);
+void
+generate_level(Level *level, const Level_generator_params *params, u64 level_seed, void *memory);
+
+// Generates level_count levels of the generator on the pool's workers. The
+// result does not depend on the number of workers.
+void
+generate_levels(Generated_levels *levels, const Level_generator *generator, i32 level_count, Job_pool *pool);
+void
+free_generated_levels(Generated_levels *levels);
+
+// Endless mode, every level is generated when it is entered or prefetched. The
+// generator has to outlive the game.
+bool
+game_init(Game_state *game_state, u64 seed, const Level_generator *generator);
+
+#endif
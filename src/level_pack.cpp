@@ -0,0 +1,298 @@
+#include "level_pack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(Collectable_type) == sizeof(i32), "Level packs store collectable types as i32.");
+
+size_t
+level_pack_data_size(i32 num_rows, i32 num_cols, i32 num_blocks)
+{
+   i32 num_cells = num_rows * num_cols;
+   i32 num_alive_words = (num_cells + 63) / 64;
+
+   return num_alive_words * sizeof(u64) +
+          num_blocks * (2 * sizeof(f32) + 2 * sizeof(i32)) +
+          num_cells * sizeof(i32);
+}
+
+static u64
+align_pack_offset(u64 offset)
+{
+   return (offset + LEVEL_PACK_ALIGNMENT-1) / LEVEL_PACK_ALIGNMENT * LEVEL_PACK_ALIGNMENT;
+}
+
+bool
+level_pack_write(const char *path, const char **level_texts, i32 level_count)
+{
+   PROFILE_ZONE("level_pack_write");
+
+   Level *levels = (Level *)malloc(level_count * sizeof(Level));
+   Level_pack_entry *entries = (Level_pack_entry *)calloc(level_count, sizeof(Level_pack_entry));
+   defer { free(levels); free(entries); };
+
+   u64 offset = align_pack_offset(sizeof(Level_pack_header) + level_count * sizeof(Level_pack_entry));
+   size_t max_memory_size = 0;
+
+   for (i32 level_index = 0; level_index < level_count; ++level_index)
+   {
+      Level *level = &levels[level_index];
+      if (!parse_level(level, level_texts[level_index], level_index))
+         return false;
+
+      Level_pack_entry *entry = &entries[level_index];
+      entry->offset = offset;
+      entry->num_bytes = level_pack_data_size(level->num_rows, level->num_cols, level->num_blocks);
+      entry->num_rows = level->num_rows;
+      entry->num_cols = level->num_cols;
+      entry->num_blocks = level->num_blocks;
+
+      offset = align_pack_offset(offset + entry->num_bytes);
+      max_memory_size = max(max_memory_size, level->memory_size);
+   }
+
+   FILE *file = fopen(path, "wb");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open level pack '%s' for writing.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   Level_pack_header header;
+   header.magic = LEVEL_PACK_MAGIC;
+   header.version = LEVEL_PACK_VERSION;
+   header.num_levels = (u32)level_count;
+   header.entries_offset = sizeof(Level_pack_header);
+
+   bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(entries, sizeof(Level_pack_entry), level_count, file) == (size_t)level_count;
+
+   void *scratch = aligned_alloc(LEVEL_MEMORY_ALIGNMENT, max(max_memory_size, (size_t)LEVEL_MEMORY_ALIGNMENT));
+   defer { free(scratch); };
+
+   static const u8 zeros[LEVEL_PACK_ALIGNMENT] = {};
+
+   for (i32 level_index = 0; ok && level_index < level_count; ++level_index)
+   {
+      Level *level = &levels[level_index];
+      load_level(level, level_texts[level_index], scratch);
+
+      i32 num_cells = level->num_rows * level->num_cols;
+      i32 num_alive_words = (num_cells + 63) / 64;
+
+      size_t padding = entries[level_index].offset - ftell(file);
+      ok = fwrite(zeros, 1, padding, file) == padding &&
+           fwrite(level->alive_cells, sizeof(u64), num_alive_words, file) == (size_t)num_alive_words &&
+           fwrite(level->translations_x, sizeof(f32), level->num_blocks, file) == (size_t)level->num_blocks &&
+           fwrite(level->translations_y, sizeof(f32), level->num_blocks, file) == (size_t)level->num_blocks &&
+           fwrite(level->collectable_types, sizeof(i32), level->num_blocks, file) == (size_t)level->num_blocks &&
+           fwrite(level->block_cells, sizeof(i32), level->num_blocks, file) == (size_t)level->num_blocks &&
+           fwrite(level->cell_blocks, sizeof(i32), num_cells, file) == (size_t)num_cells;
+   }
+
+   if (!ok)
+   {
+      fprintf(stderr, "Failed to write level pack '%s'.\n", path);
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+check_pack_entry(const Level_pack_entry *entry, size_t memory_size)
+{
+   if (entry->num_rows < 0 || entry->num_cols < 0 || entry->num_blocks < 0)
+      return false;
+   if ((i64)entry->num_rows * entry->num_cols > INT32_MAX ||
+       entry->num_blocks > entry->num_rows * entry->num_cols)
+      return false;
+   if (entry->offset % sizeof(u64) ||
+       entry->num_bytes != level_pack_data_size(entry->num_rows, entry->num_cols, entry->num_blocks))
+      return false;
+
+   return entry->offset <= memory_size && entry->num_bytes <= memory_size - entry->offset;
+}
+
+static Level_table
+entry_table(const void *memory, const Level_pack_entry *entry)
+{
+   const u8 *data = (const u8 *)memory + entry->offset;
+
+   i32 num_cells = entry->num_rows * entry->num_cols;
+   i32 num_alive_words = (num_cells + 63) / 64;
+
+   Level_table table;
+   table.num_rows = entry->num_rows;
+   table.num_cols = entry->num_cols;
+   table.num_blocks = entry->num_blocks;
+   table.alive_cells = (const u64 *)data;
+   table.translations_x = (const f32 *)(table.alive_cells + num_alive_words);
+   table.translations_y = table.translations_x + entry->num_blocks;
+   table.collectable_types = (const Collectable_type *)(table.translations_y + entry->num_blocks);
+   table.block_cells = (const i32 *)(table.collectable_types + entry->num_blocks);
+   table.cell_blocks = table.block_cells + entry->num_blocks;
+
+   return table;
+}
+
+// The game indexes with the cells, blocks and types of a level as they are,
+// so all of them have to be in range, both directions of the cell mapping have
+// to agree and a cell has to be alive iff it holds a block.
+static bool
+check_pack_level(const Level_table *table)
+{
+   i32 num_cells = table->num_rows * table->num_cols;
+
+   for (i32 block_index = 0; block_index < table->num_blocks; ++block_index)
+   {
+      i32 cell = table->block_cells[block_index];
+      if (cell < 0 || cell >= num_cells || table->cell_blocks[cell] != block_index)
+         return false;
+
+      i32 type = (i32)table->collectable_types[block_index];
+      if (type < COLLECTABLE_TYPE_NONE || type > COLLECTABLE_TYPE_BALL_SPLIT)
+         return false;
+   }
+
+   for (i32 cell = 0; cell < num_cells; ++cell)
+   {
+      i32 block_index = table->cell_blocks[cell];
+      if (block_index < -1 || block_index >= table->num_blocks ||
+          (block_index >= 0 && table->block_cells[block_index] != cell))
+         return false;
+
+      bool alive = (table->alive_cells[cell / 64] >> (cell % 64)) & 1;
+      if (alive != (block_index >= 0))
+         return false;
+   }
+
+   // Bits past the last cell are never read, but they are uploaded.
+   if (num_cells % 64 && table->alive_cells[num_cells / 64] >> (num_cells % 64))
+      return false;
+
+   return true;
+}
+
+bool
+level_pack_open(Level_pack *pack, const char *path)
+{
+   PROFILE_ZONE("level_pack_open");
+
+   i32 fd = open(path, O_RDONLY);
+   if (fd < 0)
+   {
+      fprintf(stderr, "Failed to open level pack '%s'.\n", path);
+      return false;
+   }
+   defer { close(fd); };
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Level_pack_header))
+   {
+      fprintf(stderr, "'%s' is not a level pack.\n", path);
+      return false;
+   }
+
+   // The mapping outlives the descriptor.
+   size_t memory_size = (size_t)st.st_size;
+   void *memory = mmap(0, memory_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (memory == MAP_FAILED)
+   {
+      fprintf(stderr, "Failed to map level pack '%s'.\n", path);
+      return false;
+   }
+
+   const Level_pack_header *header = (const Level_pack_header *)memory;
+   const char *error = 0;
+
+   if (header->magic != LEVEL_PACK_MAGIC)
+      error = "is not a level pack";
+   else if (header->version != LEVEL_PACK_VERSION)
+      error = "has an unsupported version";
+   else if (header->entries_offset % sizeof(u64) ||
+            header->entries_offset > memory_size ||
+            header->num_levels > (memory_size - header->entries_offset) / sizeof(Level_pack_entry))
+      error = "has a truncated index";
+
+   if (!error)
+   {
+      pack->entries = (const Level_pack_entry *)((u8 *)memory + header->entries_offset);
+      for (u32 level_index = 0; level_index < header->num_levels; ++level_index)
+      {
+         if (!check_pack_entry(&pack->entries[level_index], memory_size))
+         {
+            error = "has a corrupt index";
+            break;
+         }
+      }
+   }
+
+   // Reads every page of the pack once, about what loading all of its levels
+   // would cost.
+   char level_error[64];
+   for (u32 level_index = 0; !error && level_index < header->num_levels; ++level_index)
+   {
+      Level_table table = entry_table(memory, &pack->entries[level_index]);
+      if (!check_pack_level(&table))
+      {
+         snprintf(level_error, sizeof(level_error), "has a corrupt level %u", level_index+1);
+         error = level_error;
+      }
+   }
+
+   if (error)
+   {
+      fprintf(stderr, "Level pack '%s' %s.\n", path, error);
+      munmap(memory, memory_size);
+      return false;
+   }
+
+   pack->memory = memory;
+   pack->memory_size = memory_size;
+   pack->num_levels = (i32)header->num_levels;
+
+   return true;
+}
+
+void
+level_pack_close(Level_pack *pack)
+{
+   munmap(pack->memory, pack->memory_size);
+   pack->memory = 0;
+   pack->memory_size = 0;
+   pack->num_levels = 0;
+   pack->entries = 0;
+}
+
+Level_table
+level_pack_table(const Level_pack *pack, i32 level_index)
+{
+   assert(0 <= level_index && level_index < pack->num_levels);
+
+   return entry_table(pack->memory, &pack->entries[level_index]);
+}
+
+static void
+load_level_pack_level(const void *data, i32 level_index, Level_slot *slot)
+{
+   Level_table table = level_pack_table((const Level_pack *)data, level_index);
+   load_level_table_slot(slot, &table, level_index);
+}
+
+bool
+game_init(Game_state *game_state, u64 seed, const Level_pack *pack)
+{
+   Level_source source;
+   source.data = pack;
+   source.load = load_level_pack_level;
+
+   return game_init(game_state, seed, source, pack->num_levels);
+}
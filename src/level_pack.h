@@ -0,0 +1,76 @@
+#ifndef LEVEL_PACK_H
+#define LEVEL_PACK_H
+
+#include "game.h"
+
+// A level pack is a file of already compiled levels, so new levels ship
+// without rebuilding the game. It is memory mapped and read in place: a
+// level's Level_table points straight into the mapping, so looking one up is
+// an index read plus a few pointer additions.
+//
+// Layout: Level_pack_header, num_levels Level_pack_entries, then every level's
+// data at a LEVEL_PACK_ALIGNMENT aligned offset:
+//    alive cells (u64 x num_alive_words), translations x, translations y,
+//    collectable types (i32), block cells (i32) (each x num_blocks),
+//    cell blocks (i32 x num_cells).
+// Everything is little endian. Packs are built by arkanoid_pack, see
+// level_pack_tool.cpp. The index and the data of every level are validated on
+// open, the game indexes with the cells and blocks as they are.
+//
+// Entering a level still copies its data into the game's level slot instead of
+// pointing the Level into the mapping: the game destroys blocks by reordering
+// those arrays and keeps their colors next to them, while the pack has to stay
+// untouched for the next time the level is entered. The copy is a few memcpys,
+// nothing is parsed and nothing is allocated per block.
+
+#define LEVEL_PACK_MAGIC 0x4c4b5241 // "ARKL"
+#define LEVEL_PACK_VERSION 1
+#define LEVEL_PACK_ALIGNMENT 64
+
+struct Level_pack_header
+{
+   u32 magic;
+   u32 version;
+   u32 num_levels;
+   u32 entries_offset;
+};
+
+struct Level_pack_entry
+{
+   u64 offset;
+   u64 num_bytes;
+   i32 num_rows;
+   i32 num_cols;
+   i32 num_blocks;
+   u32 reserved;
+};
+
+struct Level_pack
+{
+   void *memory;
+   size_t memory_size;
+
+   i32 num_levels;
+   const Level_pack_entry *entries;
+};
+
+size_t
+level_pack_data_size(i32 num_rows, i32 num_cols, i32 num_blocks);
+
+bool
+level_pack_write(const char *path, const char **level_texts, i32 level_count);
+
+bool
+level_pack_open(Level_pack *pack, const char *path);
+void
+level_pack_close(Level_pack *pack);
+
+Level_table
+level_pack_table(const Level_pack *pack, i32 level_index);
+
+// Plays the levels of the pack, which stays open until the game is freed.
+// Levels are read from the mapping when they are entered.
+bool
+game_init(Game_state *game_state, u64 seed, const Level_pack *pack);
+
+#endif
@@ -0,0 +1,108 @@
+#include "game.h"
+#include "game.cpp"
+#include "level_pack.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Converts level texts into a level pack, see level_pack.h.
+// Usage: arkanoid_pack output.pack [levels.txt ...]
+//
+// Every text file holds one or more levels in the levels.h format, separated
+// by blank lines. Without input files the levels of levels.h are packed.
+
+static char *
+read_text_file(const char *path)
+{
+   FILE *file = fopen(path, "rb");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open level file '%s'.\n", path);
+      return 0;
+   }
+   defer { fclose(file); };
+
+   fseek(file, 0, SEEK_END);
+   long num_bytes = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   char *text = (char *)malloc(num_bytes + 1);
+   if (fread(text, 1, num_bytes, file) != (size_t)num_bytes)
+   {
+      fprintf(stderr, "Failed to read level file '%s'.\n", path);
+      free(text);
+      return 0;
+   }
+   text[num_bytes] = 0;
+
+   return text;
+}
+
+// Splits text in place, each level keeps the newline that ends its last row.
+static void
+split_levels(char *text, Array<const char *> *level_texts)
+{
+   char *cursor = text;
+   for (;;)
+   {
+      while (*cursor == BOARD_SYMBOL_NEW_ROW)
+         ++cursor;
+      if (!*cursor)
+         break;
+
+      array_add(level_texts, (const char *)cursor);
+
+      while (*cursor && !(cursor[0] == BOARD_SYMBOL_NEW_ROW && cursor[1] == BOARD_SYMBOL_NEW_ROW))
+         ++cursor;
+      if (*cursor)
+      {
+         cursor[1] = 0;
+         cursor += 2;
+      }
+   }
+}
+
+i32
+main(i32 argc, char **argv)
+{
+   if (argc < 2)
+   {
+      fprintf(stderr, "Usage: %s output.pack [levels.txt ...]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   const char *pack_path = argv[1];
+
+   Array<const char *> level_texts = array_create<const char *>();
+   Array<char *> file_texts = array_create<char *>();
+   defer
+   {
+      for (i32 i = 0; i < file_texts.length; ++i)
+         free(file_texts.data[i]);
+      array_free(file_texts);
+      array_free(level_texts);
+   };
+
+   if (argc == 2)
+   {
+      for (i32 level_index = 0; level_index < num_levels; ++level_index)
+         array_add(&level_texts, all_levels[level_index]);
+   }
+
+   for (i32 i = 2; i < argc; ++i)
+   {
+      char *text = read_text_file(argv[i]);
+      if (!text)
+         return EXIT_FAILURE;
+
+      array_add(&file_texts, text);
+      split_levels(text, &level_texts);
+   }
+
+   if (!level_pack_write(pack_path, level_texts.data, level_texts.length))
+      return EXIT_FAILURE;
+
+   printf("Packed %d levels into '%s'.\n", level_texts.length, pack_path);
+
+   return EXIT_SUCCESS;
+}
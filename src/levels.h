@@ -7,9 +7,10 @@
 #define BOARD_SYMBOL_BLOCK_SHORT_PADDLE 'p'
 #define BOARD_SYMBOL_BLOCK_FAST_BALL 'B'
 #define BOARD_SYMBOL_BLOCK_SLOW_BALL 'b'
+#define BOARD_SYMBOL_BLOCK_BALL_SPLIT 'S'
 #define BOARD_SYMBOL_NEW_ROW '\n'
 
-const char *level_1 =
+constexpr char level_1[] =
 R"FOO(
 .............
 .............
@@ -26,7 +27,7 @@ XXXXXbXBPXpXX
 .............
 )FOO";
 
-const char *level_2 =
+constexpr char level_2[] =
 R"FOO(
 .....
 .....
@@ -50,7 +51,7 @@ R"FOO(
 .....
 )FOO";
 
-const char *level_3 =
+constexpr char level_3[] =
 R"FOO(
 .....
 .XXX.
@@ -62,7 +63,7 @@ R"FOO(
 .....
 )FOO";
 
-const char *test_level_1 =
+constexpr char test_level_1[] =
 R"FOO(
 ...
 ...
@@ -93,7 +94,7 @@ R"FOO(
 XXb
 )FOO";
 
-const char *test_level_2 =
+constexpr char test_level_2[] =
 R"FOO(
 ...
 ...
@@ -124,9 +125,20 @@ R"FOO(
 X..
 )FOO";
 
+// Every level in the order they are played. Expands X(level) for each of them,
+// so that the texts and their compiled tables stay in sync.
+#define ALL_LEVELS(X) \
+   X(test_level_1) \
+   X(test_level_2) \
+   X(level_1) \
+   X(level_2) \
+   X(level_3)
+
+#define LEVEL_TEXT(level) level,
 const char *all_levels[] = {
-   test_level_1, test_level_2, level_1, level_2, level_3,
+   ALL_LEVELS(LEVEL_TEXT)
 };
+#undef LEVEL_TEXT
 
 i32 num_levels = sizeof(all_levels) / sizeof(all_levels[0]);
 
@@ -111,6 +111,12 @@ normalized(v2 v)
    return v / len;
 }
 
+inline v2
+lerp(v2 u, v2 v, f32 t)
+{
+   return (1.0f-t) * u + t * v;
+}
+
 inline v2
 v2_of_angle(f32 a)
 {
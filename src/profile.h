@@ -0,0 +1,164 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "base.h"
+
+// PROFILE_ZONE("name") times the rest of the enclosing scope. Zones are only
+// recorded when ARKANOID_PROFILE is defined (make PROFILE=1 ...), otherwise the
+// macro expands to nothing. profile_write_trace saves every recorded zone as a
+// Chrome trace that chrome://tracing and ui.perfetto.dev can open.
+//
+// Each thread appends to its own buffer, so recording never takes a lock. A
+// thread's buffer is pushed onto a global list the first time it records a
+// zone. Buffers are rings that keep a thread's latest MAX_EVENTS zones, older
+// ones are overwritten. Names must be string literals, only the pointers are
+// kept.
+
+#ifdef ARKANOID_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct Profile_event
+{
+   const char *name;
+   u64 begin_ns;
+   u64 end_ns;
+};
+
+struct Profile_buffer
+{
+   // A power of two, event i of the thread is in slot i % MAX_EVENTS.
+   static const i32 MAX_EVENTS = 1 << 20;
+
+   Profile_buffer *next;
+   i32 thread_index;
+   // Every event the thread recorded, the latest MAX_EVENTS of them are still
+   // in the ring. Written only by the owning thread, stored with release so
+   // that a reader sees all the events it counts.
+   i64 num_events;
+   Profile_event events[MAX_EVENTS];
+};
+
+struct Profiler
+{
+   Profile_buffer *buffers;
+   i32 num_threads;
+};
+
+inline Profiler global_profiler;
+inline thread_local Profile_buffer *thread_profile_buffer;
+
+inline u64
+profile_time_ns()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+inline Profile_buffer *
+profile_thread_buffer()
+{
+   Profile_buffer *buffer = thread_profile_buffer;
+   if (buffer)
+      return buffer;
+
+   buffer = (Profile_buffer *)malloc(sizeof(Profile_buffer));
+   buffer->thread_index = __atomic_fetch_add(&global_profiler.num_threads, 1, __ATOMIC_RELAXED);
+   buffer->num_events = 0;
+
+   buffer->next = __atomic_load_n(&global_profiler.buffers, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&global_profiler.buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+   thread_profile_buffer = buffer;
+   return buffer;
+}
+
+inline void
+profile_record(const char *name, u64 begin_ns)
+{
+   u64 end_ns = profile_time_ns();
+   Profile_buffer *buffer = profile_thread_buffer();
+
+   i64 num_events = buffer->num_events;
+   Profile_event *event = &buffer->events[num_events & (Profile_buffer::MAX_EVENTS-1)];
+   event->name = name;
+   event->begin_ns = begin_ns;
+   event->end_ns = end_ns;
+   __atomic_store_n(&buffer->num_events, num_events+1, __ATOMIC_RELEASE);
+}
+
+#define PROFILE_ZONE(name) \
+   u64 CONCAT(profile_zone_begin_, __LINE__) = profile_time_ns(); \
+   defer { profile_record(name, CONCAT(profile_zone_begin_, __LINE__)); }
+
+// Zones still being recorded by other threads may or may not make it in, and
+// may overwrite zones of theirs as they are written, so they should be idle.
+inline bool
+profile_write_trace(const char *path)
+{
+   Profile_buffer *buffers = __atomic_load_n(&global_profiler.buffers, __ATOMIC_ACQUIRE);
+
+   u64 first_ns = ~0ull;
+   for (Profile_buffer *buffer = buffers; buffer; buffer = buffer->next)
+   {
+      i64 num_events = __atomic_load_n(&buffer->num_events, __ATOMIC_ACQUIRE);
+      i64 first_event = max(num_events - Profile_buffer::MAX_EVENTS, (i64)0);
+      for (i64 i = first_event; i < num_events; ++i)
+         first_ns = min(first_ns, buffer->events[i & (Profile_buffer::MAX_EVENTS-1)].begin_ns);
+   }
+
+   FILE *file = fopen(path, "w");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open trace file '%s'.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   i64 num_written = 0;
+   i64 num_overwritten = 0;
+
+   fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+   for (Profile_buffer *buffer = buffers; buffer; buffer = buffer->next)
+   {
+      i64 num_events = __atomic_load_n(&buffer->num_events, __ATOMIC_ACQUIRE);
+      i64 first_event = max(num_events - Profile_buffer::MAX_EVENTS, (i64)0);
+      for (i64 i = first_event; i < num_events; ++i)
+      {
+         Profile_event *event = &buffer->events[i & (Profile_buffer::MAX_EVENTS-1)];
+         fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+               num_written ? ",\n" : "",
+               event->name,
+               buffer->thread_index,
+               (event->begin_ns - first_ns) * 1e-3,
+               (event->end_ns - event->begin_ns) * 1e-3);
+         ++num_written;
+      }
+      num_overwritten += first_event;
+   }
+   fprintf(file, "\n]}\n");
+
+   printf("Wrote %lld profile zones to '%s'.\n", (long long)num_written, path);
+   if (num_overwritten)
+      printf("%lld older zones were overwritten, the trace has the latest %d of each thread.\n",
+             (long long)num_overwritten, Profile_buffer::MAX_EVENTS);
+
+   return true;
+}
+
+#else
+
+#define PROFILE_ZONE(name)
+
+inline bool
+profile_write_trace(const char *)
+{
+   return true;
+}
+
+#endif
+
+#endif
@@ -1,20 +1,176 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-// TODO(hobrzut): Remove.
-#include <stdlib.h>
+// xoshiro128+ generator. The whole state lives in the series, so every game
+// owns its own stream and runs are reproducible from the seed.
+struct Random_series
+{
+   u32 state[4];
+};
+
+inline u64
+splitmix64(u64 *x)
+{
+   u64 z = (*x += 0x9e3779b97f4a7c15ull);
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+   return z ^ (z >> 31);
+}
+
+inline Random_series
+random_seed(u64 seed)
+{
+   Random_series series;
+
+   u64 a = splitmix64(&seed);
+   u64 b = splitmix64(&seed);
+   series.state[0] = (u32)a;
+   series.state[1] = (u32)(a >> 32);
+   series.state[2] = (u32)b;
+   series.state[3] = (u32)(b >> 32);
+
+   return series;
+}
+
+inline u32
+rotate_left(u32 x, i32 k)
+{
+   return (x << k) | (x >> (32 - k));
+}
+
+inline u32
+random_next_u32(Random_series *series)
+{
+   u32 *s = series->state;
+   u32 result = s[0] + s[3];
+   u32 t = s[1] << 9;
+
+   s[2] ^= s[0];
+   s[3] ^= s[1];
+   s[1] ^= s[2];
+   s[0] ^= s[3];
+   s[2] ^= t;
+   s[3] = rotate_left(s[3], 11);
+
+   return result;
+}
 
 inline f32
-random_unilateral()
+random_unilateral(Random_series *series)
 {
-   return (f32)rand() / RAND_MAX;
+   // Top 24 bits, the low bits of xoshiro128+ are weak.
+   return (random_next_u32(series) >> 8) * (1.0f / 16777216.0f);
 }
 
 inline f32
-random_between(f32 min, f32 max)
+random_between(Random_series *series, f32 min, f32 max)
 {
-   f32 t = random_unilateral();
+   f32 t = random_unilateral(series);
    return (1-t) * min + t * max;
 }
 
+// RANDOM_LANES independent streams advanced together, one per SIMD lane. Lane i
+// produces the same sequence as a Random_series seeded the same way.
+#define RANDOM_LANES 8
+
+struct alignas(32) Random_series_wide
+{
+   u32 state[4][RANDOM_LANES];
+};
+
+inline Random_series_wide
+random_seed_wide(const u64 seeds[RANDOM_LANES])
+{
+   Random_series_wide series;
+   for (i32 lane = 0; lane < RANDOM_LANES; ++lane)
+   {
+      Random_series lane_series = random_seed(seeds[lane]);
+      for (i32 i = 0; i < 4; ++i)
+         series.state[i][lane] = lane_series.state[i];
+   }
+
+   return series;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+inline void
+random_next_u32_wide_avx2(Random_series_wide *series, u32 out[RANDOM_LANES])
+{
+   __m256i s0 = _mm256_load_si256((__m256i *)series->state[0]);
+   __m256i s1 = _mm256_load_si256((__m256i *)series->state[1]);
+   __m256i s2 = _mm256_load_si256((__m256i *)series->state[2]);
+   __m256i s3 = _mm256_load_si256((__m256i *)series->state[3]);
+
+   _mm256_storeu_si256((__m256i *)out, _mm256_add_epi32(s0, s3));
+   __m256i t = _mm256_slli_epi32(s1, 9);
+
+   s2 = _mm256_xor_si256(s2, s0);
+   s3 = _mm256_xor_si256(s3, s1);
+   s1 = _mm256_xor_si256(s1, s2);
+   s0 = _mm256_xor_si256(s0, s3);
+   s2 = _mm256_xor_si256(s2, t);
+   s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+
+   _mm256_store_si256((__m256i *)series->state[0], s0);
+   _mm256_store_si256((__m256i *)series->state[1], s1);
+   _mm256_store_si256((__m256i *)series->state[2], s2);
+   _mm256_store_si256((__m256i *)series->state[3], s3);
+}
+
+inline void
+random_next_u32_wide_sse2(Random_series_wide *series, u32 out[RANDOM_LANES])
+{
+   for (i32 half = 0; half < RANDOM_LANES/4; ++half)
+   {
+      __m128i s0 = _mm_load_si128((__m128i *)(series->state[0] + 4*half));
+      __m128i s1 = _mm_load_si128((__m128i *)(series->state[1] + 4*half));
+      __m128i s2 = _mm_load_si128((__m128i *)(series->state[2] + 4*half));
+      __m128i s3 = _mm_load_si128((__m128i *)(series->state[3] + 4*half));
+
+      _mm_storeu_si128((__m128i *)(out + 4*half), _mm_add_epi32(s0, s3));
+      __m128i t = _mm_slli_epi32(s1, 9);
+
+      s2 = _mm_xor_si128(s2, s0);
+      s3 = _mm_xor_si128(s3, s1);
+      s1 = _mm_xor_si128(s1, s2);
+      s0 = _mm_xor_si128(s0, s3);
+      s2 = _mm_xor_si128(s2, t);
+      s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+      _mm_store_si128((__m128i *)(series->state[0] + 4*half), s0);
+      _mm_store_si128((__m128i *)(series->state[1] + 4*half), s1);
+      _mm_store_si128((__m128i *)(series->state[2] + 4*half), s2);
+      _mm_store_si128((__m128i *)(series->state[3] + 4*half), s3);
+   }
+}
+
+#endif
+
+inline void
+random_next_u32_wide(Random_series_wide *series, u32 out[RANDOM_LANES])
+{
+#if defined(__x86_64__) || defined(__i386__)
+   static const bool has_avx2 = __builtin_cpu_supports("avx2");
+   if (has_avx2)
+      random_next_u32_wide_avx2(series, out);
+   else
+      random_next_u32_wide_sse2(series, out);
+#else
+   for (i32 lane = 0; lane < RANDOM_LANES; ++lane)
+   {
+      Random_series lane_series;
+      for (i32 i = 0; i < 4; ++i)
+         lane_series.state[i] = series->state[i][lane];
+
+      out[lane] = random_next_u32(&lane_series);
+
+      for (i32 i = 0; i < 4; ++i)
+         series->state[i][lane] = lane_series.state[i];
+   }
+#endif
+}
+
 #endif
@@ -0,0 +1,443 @@
+static v2 square[] = {
+   { -1.0f, -1.0f },
+   { -1.0f,  1.0f },
+   {  1.0f, -1.0f },
+   {  1.0f,  1.0f },
+};
+
+static const v3 PADDLE_COLOR = { 80.0f/255, 120.0f/255, 111.0f/255 };
+static const v3 BALL_COLOR = { 244.0f/255, 192.0f/255, 149.0f/255 };
+
+// Texture units of the sprite shader's buffer textures.
+#define ALIVE_CELLS_TEXTURE_UNIT 0
+#define LEVEL_SPRITES_TEXTURE_UNIT 1
+#define FRAME_SPRITES_TEXTURE_UNIT 2
+#define BACKGROUND_TILE_TEXTURE_UNIT 3
+
+static GLuint
+create_square_vao()
+{
+   GLuint vao;
+   GL_CALL(glGenVertexArrays(1, &vao));
+   GL_CALL(glBindVertexArray(vao));
+
+   GLuint square_vbo;
+   GL_CALL(glGenBuffers(1, &square_vbo));
+   GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, square_vbo));
+   GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(square), square, GL_STATIC_DRAW));
+
+   GL_CALL(glEnableVertexAttribArray(0));
+   GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0));
+
+   return vao;
+}
+
+// Every glBufferSubData of upload_frame goes through here, so that it is
+// counted. Writes into mapped memory count their bytes themselves.
+static void
+upload_buffer_range(Renderer *renderer, GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+   GL_CALL(glBufferSubData(target, offset, size, data));
+   renderer->upload_bytes += size;
+}
+
+static void
+set_texture_unit(GLuint shader, const char *name, GLint unit)
+{
+   GLint uniform;
+   GL_CALL(uniform = glGetUniformLocation(shader, name));
+   GL_CALL(glUniform1i(uniform, unit));
+}
+
+static Sprite
+make_sprite(v2 translate, f32 half_width, f32 half_height, v3 color, Sprite_shape shape)
+{
+   Sprite sprite;
+   sprite.translate = translate;
+   sprite.half_size = V2(half_width, half_height);
+   sprite.color = color;
+   sprite.shape = (f32)shape;
+   return sprite;
+}
+
+static bool
+render_background_tile(Renderer *renderer)
+{
+   GLuint tile_shader = Graphics::compile_shaders(&renderer->program_cache, background_vertex_code, background_tile_fragment_code);
+   if (!tile_shader)
+   {
+      fprintf(stderr, "Failed to load background tile shader.\n");
+      return false;
+   }
+
+   GL_CALL(glGenTextures(1, &renderer->bg_tile_texture));
+   GL_CALL(glBindTexture(GL_TEXTURE_2D, renderer->bg_tile_texture));
+   GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, BACKGROUND_TILE_SIZE, BACKGROUND_TILE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0));
+   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+   GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0));
+
+   GLuint framebuffer;
+   GL_CALL(glGenFramebuffers(1, &framebuffer));
+   GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+   GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderer->bg_tile_texture, 0));
+   defer
+   {
+      GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+      GL_CALL(glDeleteFramebuffers(1, &framebuffer));
+      GL_CALL(glDeleteProgram(tile_shader));
+   };
+
+   GLenum status;
+   GL_CALL(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+   if (status != GL_FRAMEBUFFER_COMPLETE)
+   {
+      fprintf(stderr, "Background tile framebuffer is incomplete [%d].\n", status);
+      return false;
+   }
+
+   GLint viewport[4];
+   GL_CALL(glGetIntegerv(GL_VIEWPORT, viewport));
+
+   GL_CALL(glViewport(0, 0, BACKGROUND_TILE_SIZE, BACKGROUND_TILE_SIZE));
+   GL_CALL(glUseProgram(tile_shader));
+   GL_CALL(glBindVertexArray(renderer->quad_vao));
+   GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+
+   GL_CALL(glViewport(viewport[0], viewport[1], viewport[2], viewport[3]));
+
+   return true;
+}
+
+// A level's sprites and alive cells are each read from one buffer texture. GL
+// 3.3 only promises 65536 texels of them, drivers tend to allow far more.
+static bool
+level_fits_texture_buffers(Renderer *renderer, Level *level)
+{
+   i64 num_sprite_texels = 2 * (i64)level->num_blocks;
+   i64 num_alive_texels = ((i64)level->num_rows * level->num_cols + 63) / 64 * 2;
+   if (num_sprite_texels > renderer->max_texture_buffer_texels ||
+       num_alive_texels > renderer->max_texture_buffer_texels)
+   {
+      fprintf(stderr, "Level of %d blocks in %d x %d cells is too large to draw, this GL allows %d texels per buffer texture.\n",
+              level->num_blocks, level->num_rows, level->num_cols, renderer->max_texture_buffer_texels);
+      return false;
+   }
+   return true;
+}
+
+bool
+renderer_init(Renderer *renderer, Game_state *game_state, const char *shader_cache_directory)
+{
+   PROFILE_ZONE("renderer_init");
+
+   // Refuses a level that can't be drawn before anything is set up for it,
+   // a stress level is the only level it will ever see.
+   GL_CALL(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &renderer->max_texture_buffer_texels));
+   if (!level_fits_texture_buffers(renderer, game_state->level))
+      return false;
+
+   Graphics::program_cache_init(&renderer->program_cache, shader_cache_directory);
+
+   renderer->bg_shader = Graphics::compile_shaders(&renderer->program_cache, background_vertex_code, background_fragment_code);
+   if (!renderer->bg_shader)
+   {
+      fprintf(stderr, "Failed to load background shader.\n");
+      return false;
+   }
+
+   renderer->sprite_shader = Graphics::compile_shaders(&renderer->program_cache, sprite_vertex_code, sprite_fragment_code);
+   if (!renderer->sprite_shader)
+   {
+      fprintf(stderr, "Failed to load sprite shader.\n");
+      return false;
+   }
+
+   GL_CALL(renderer->bg_shader_pulse_uniform = glGetUniformLocation(renderer->bg_shader, "pulse"));
+   GL_CALL(renderer->sprite_shader_num_level_sprites_uniform = glGetUniformLocation(renderer->sprite_shader, "num_level_sprites"));
+   GL_CALL(renderer->sprite_shader_frame_sprites_base_uniform = glGetUniformLocation(renderer->sprite_shader, "frame_sprites_base"));
+
+   GL_CALL(glUseProgram(renderer->sprite_shader));
+   set_texture_unit(renderer->sprite_shader, "alive_cells", ALIVE_CELLS_TEXTURE_UNIT);
+   set_texture_unit(renderer->sprite_shader, "level_sprites", LEVEL_SPRITES_TEXTURE_UNIT);
+   set_texture_unit(renderer->sprite_shader, "frame_sprites", FRAME_SPRITES_TEXTURE_UNIT);
+
+   GL_CALL(glUseProgram(renderer->bg_shader));
+   set_texture_unit(renderer->bg_shader, "tile", BACKGROUND_TILE_TEXTURE_UNIT);
+
+   // The shader pulls the instances itself, the square is all the VAO has.
+   renderer->quad_vao = create_square_vao();
+
+   if (!render_background_tile(renderer))
+      return false;
+
+   {
+      Level_graphics *blocks = &renderer->blocks;
+      GL_CALL(glGenBuffers(1, &blocks->sprites_buffer));
+      GL_CALL(glGenTextures(1, &blocks->sprites_texture));
+      blocks->sprites_allocated_size = 0;
+
+      GL_CALL(glGenBuffers(1, &blocks->alive_cells_buffer));
+      GL_CALL(glGenTextures(1, &blocks->alive_cells_texture));
+      blocks->alive_cells_allocated_size = 0;
+   }
+
+   // The paddle, then every collectable and every ball.
+   {
+      i32 max_num_sprites = 1 + game_state->collectables.MAX_NUM_COLLECTABLES + Balls::MAX_NUM_BALLS;
+      if (!Graphics::create_stream_buffer(&renderer->stream, max_num_sprites * sizeof(Sprite)))
+         return false;
+
+      i64 num_frames = renderer->stream.persistent ? STREAM_BUFFER_FRAMES : 1;
+      i64 num_stream_texels = num_frames * renderer->stream.frame_size / (sizeof(Sprite) / 2);
+      if (num_stream_texels > renderer->max_texture_buffer_texels)
+      {
+         fprintf(stderr, "Streaming buffer of %lld texels is too large, this GL allows %d texels per buffer texture.\n",
+                 (long long)num_stream_texels, renderer->max_texture_buffer_texels);
+         return false;
+      }
+
+      // Views the whole ring, draw_frame tells the shader where the frame is.
+      GL_CALL(glGenTextures(1, &renderer->frame_sprites_texture));
+      GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, renderer->frame_sprites_texture));
+      GL_CALL(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, renderer->stream.buffer));
+   }
+
+   // Force the upload of the first level on the first frame.
+   renderer->uploaded_level_index = -1;
+   renderer->uploaded_blocks_version = 0;
+   renderer->upload_bytes = 0;
+
+   GL_CALL(glGenQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT, &renderer->gpu_timer_queries[0][0]));
+   for (i32 slot = 0; slot < GPU_TIMER_FRAMES; ++slot)
+      renderer->gpu_timers_issued[slot] = false;
+   renderer->gpu_timer_frame = 0;
+
+   return true;
+}
+
+bool
+upload_frame(Renderer *renderer, Game_state *game_state, f32 alpha)
+{
+   PROFILE_ZONE("upload_frame");
+
+   Paddle *paddle = &game_state->paddle;
+   Balls *balls = &game_state->balls;
+   Collectables *collectables = &game_state->collectables;
+   Level *level = game_state->level;
+   Level_graphics *blocks = &renderer->blocks;
+
+   renderer->upload_bytes = 0;
+
+   bool new_level = renderer->uploaded_level_index != game_state->level_index;
+
+   // The alive bits are uploaded as the u64 words the level keeps them in and
+   // read as u32 texels, which is the same thing on little endian machines.
+   i32 num_cells = level->num_rows * level->num_cols;
+   GLsizeiptr alive_cells_size = (num_cells + 63) / 64 * sizeof(u64);
+
+   // A new level uploads all of its blocks in their current slots. Destroying
+   // blocks shuffles the slots on the CPU, but every block keeps its cell, so
+   // the sprites stay valid for as long as the level is played.
+   if (new_level)
+   {
+      if (!level_fits_texture_buffers(renderer, level))
+         return false;
+
+      i32 num_blocks = level->num_blocks;
+      GLsizeiptr sprites_size = num_blocks * sizeof(Sprite);
+
+      GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, blocks->sprites_buffer));
+
+      if (sprites_size > blocks->sprites_allocated_size)
+      {
+         GL_CALL(glBufferData(GL_TEXTURE_BUFFER, sprites_size, 0, GL_STATIC_DRAW));
+         blocks->sprites_allocated_size = sprites_size;
+
+         GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, blocks->sprites_texture));
+         GL_CALL(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, blocks->sprites_buffer));
+      }
+
+      // The level keeps its blocks in arrays of their own, they are
+      // interleaved into sprites straight in the mapped buffer.
+      if (num_blocks > 0)
+      {
+         Sprite *sprites;
+         GL_CALL(sprites = (Sprite *)glMapBufferRange(GL_TEXTURE_BUFFER, 0, sprites_size,
+                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+         for (i32 i = 0; i < num_blocks; ++i)
+         {
+            sprites[i].translate = V2(level->translations_x[i], level->translations_y[i]);
+            sprites[i].half_size = V2(level->block_half_width, level->block_half_height);
+            sprites[i].color = level->colors[i];
+            sprites[i].cell = level->block_cells[i];
+         }
+         GL_CALL(glUnmapBuffer(GL_TEXTURE_BUFFER));
+         renderer->upload_bytes += sprites_size;
+      }
+
+      if (alive_cells_size > blocks->alive_cells_allocated_size)
+      {
+         GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, blocks->alive_cells_buffer));
+         GL_CALL(glBufferData(GL_TEXTURE_BUFFER, alive_cells_size, 0, GL_DYNAMIC_DRAW));
+         blocks->alive_cells_allocated_size = alive_cells_size;
+
+         GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, blocks->alive_cells_texture));
+         GL_CALL(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, blocks->alive_cells_buffer));
+      }
+   }
+   if (new_level || renderer->uploaded_blocks_version != game_state->blocks_version)
+   {
+      GL_CALL(glBindBuffer(GL_TEXTURE_BUFFER, blocks->alive_cells_buffer));
+
+      // Hits only re-upload the words holding the bits they cleared, unless
+      // there are so many that a single upload of all of them is cheaper.
+      u32 num_changes = game_state->blocks_version - renderer->uploaded_blocks_version;
+      bool upload_all = new_level || num_changes > MAX_ALIVE_WORD_UPLOADS;
+
+      for (u32 i = 1; !upload_all && i <= num_changes; ++i)
+      {
+         u32 version = renderer->uploaded_blocks_version + i;
+         if (game_state->block_changes[version % BLOCK_CHANGE_LOG_SIZE] == BLOCK_CHANGE_ALL)
+            upload_all = true;
+      }
+
+      if (upload_all)
+      {
+         upload_buffer_range(renderer, GL_TEXTURE_BUFFER, 0, alive_cells_size, level->alive_cells);
+      }
+      else
+      {
+         const u32 *alive_words = (const u32 *)level->alive_cells;
+         for (u32 i = 1; i <= num_changes; ++i)
+         {
+            u32 version = renderer->uploaded_blocks_version + i;
+            i32 word = game_state->block_changes[version % BLOCK_CHANGE_LOG_SIZE] / 32;
+            upload_buffer_range(renderer, GL_TEXTURE_BUFFER, word * sizeof(u32), sizeof(u32), &alive_words[word]);
+         }
+      }
+
+      renderer->uploaded_level_index = game_state->level_index;
+      renderer->uploaded_blocks_version = game_state->blocks_version;
+   }
+
+   Graphics::Stream_buffer *stream = &renderer->stream;
+   Graphics::stream_buffer_begin_frame(stream);
+
+   // Written straight into the streaming buffer, which may be mapped memory,
+   // so it is written in order and never read back. Sprites are drawn in this
+   // order, after the blocks, so balls end up on top.
+   i32 num_sprites = 1 + collectables->num_collectables + balls->num_balls;
+   GLintptr sprites_offset;
+   Sprite *sprites = (Sprite *)Graphics::stream_buffer_allocate(stream, num_sprites * sizeof(Sprite), &sprites_offset);
+
+   // Positions are interpolated between the last two simulation steps.
+   *sprites++ = make_sprite(lerp(paddle->prev_translate, paddle->translate, alpha),
+         paddle->body_half_width, paddle->body_half_height,
+         PADDLE_COLOR, SPRITE_SHAPE_RECT);
+
+   for (i32 i = 0; i < collectables->num_collectables; ++i)
+   {
+      *sprites++ = make_sprite(lerp(collectables->prev_translations[i], collectables->translations[i], alpha),
+            collectables->body_half_width, collectables->body_half_height,
+            collectables->colors[i], SPRITE_SHAPE_RECT);
+   }
+
+   for (i32 i = 0; i < balls->num_balls; ++i)
+   {
+      v2 translate;
+      translate.x = balls->prev_translations_x[i] + alpha * (balls->translations_x[i] - balls->prev_translations_x[i]);
+      translate.y = balls->prev_translations_y[i] + alpha * (balls->translations_y[i] - balls->prev_translations_y[i]);
+      *sprites++ = make_sprite(translate, balls->half_radius, balls->half_radius, BALL_COLOR, SPRITE_SHAPE_DISC);
+   }
+
+   renderer->upload_bytes += Graphics::stream_buffer_end_writes(stream);
+
+   // Allocations are aligned to whole texels.
+   renderer->frame_sprites_base = (i32)(sprites_offset / (sizeof(Sprite) / 2));
+   renderer->num_frame_sprites = num_sprites;
+
+   return true;
+}
+
+void
+draw_frame(Renderer *renderer, Game_state *game_state, f32 bg_time)
+{
+   Level *level = game_state->level;
+
+   i32 gpu_timer_slot = renderer->gpu_timer_frame % GPU_TIMER_FRAMES;
+   GLuint *gpu_timer_queries = renderer->gpu_timer_queries[gpu_timer_slot];
+
+   GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+   GL_CALL(glBindVertexArray(renderer->quad_vao));
+
+   // Draw background.
+   {
+      PROFILE_ZONE("draw_background");
+      GL_CALL(glBeginQuery(GL_TIME_ELAPSED, gpu_timer_queries[GPU_PASS_BACKGROUND]));
+      GL_CALL(glUseProgram(renderer->bg_shader));
+      GL_CALL(glActiveTexture(GL_TEXTURE0 + BACKGROUND_TILE_TEXTURE_UNIT));
+      GL_CALL(glBindTexture(GL_TEXTURE_2D, renderer->bg_tile_texture));
+      GL_CALL(glUniform1f(renderer->bg_shader_pulse_uniform, fabsf(cosf(bg_time))));
+      // The background is opaque, blending it would only cost fill rate.
+      GL_CALL(glDisable(GL_BLEND));
+      GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+      GL_CALL(glEnable(GL_BLEND));
+      GL_CALL(glEndQuery(GL_TIME_ELAPSED));
+   }
+
+   // Draw the level's blocks, then the paddle, collectables and balls.
+   {
+      PROFILE_ZONE("draw_sprites");
+      GL_CALL(glBeginQuery(GL_TIME_ELAPSED, gpu_timer_queries[GPU_PASS_SPRITES]));
+      GL_CALL(glUseProgram(renderer->sprite_shader));
+
+      GL_CALL(glActiveTexture(GL_TEXTURE0 + ALIVE_CELLS_TEXTURE_UNIT));
+      GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, renderer->blocks.alive_cells_texture));
+      GL_CALL(glActiveTexture(GL_TEXTURE0 + LEVEL_SPRITES_TEXTURE_UNIT));
+      GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, renderer->blocks.sprites_texture));
+      GL_CALL(glActiveTexture(GL_TEXTURE0 + FRAME_SPRITES_TEXTURE_UNIT));
+      GL_CALL(glBindTexture(GL_TEXTURE_BUFFER, renderer->frame_sprites_texture));
+
+      GL_CALL(glUniform1i(renderer->sprite_shader_num_level_sprites_uniform, level->num_blocks));
+      GL_CALL(glUniform1i(renderer->sprite_shader_frame_sprites_base_uniform, renderer->frame_sprites_base));
+
+      // Destroyed blocks are culled by the shader.
+      GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, level->num_blocks + renderer->num_frame_sprites));
+      GL_CALL(glEndQuery(GL_TIME_ELAPSED));
+   }
+
+   // That was the last draw to read this frame's streamed sprites.
+   Graphics::stream_buffer_end_frame(&renderer->stream);
+
+   renderer->gpu_timers_issued[gpu_timer_slot] = true;
+   ++renderer->gpu_timer_frame;
+}
+
+bool
+read_gpu_pass_times(Renderer *renderer, f32 pass_ms[GPU_PASS_COUNT])
+{
+   i32 slot = renderer->gpu_timer_frame % GPU_TIMER_FRAMES;
+   if (!renderer->gpu_timers_issued[slot])
+      return false;
+
+   renderer->gpu_timers_issued[slot] = false;
+   GLuint *queries = renderer->gpu_timer_queries[slot];
+
+   // Queries finish in order, once the last one is available all of them are.
+   GLint available;
+   GL_CALL(glGetQueryObjectiv(queries[GPU_PASS_COUNT-1], GL_QUERY_RESULT_AVAILABLE, &available));
+   if (!available)
+      return false;
+
+   for (i32 pass = 0; pass < GPU_PASS_COUNT; ++pass)
+   {
+      GLuint64 elapsed_ns;
+      GL_CALL(glGetQueryObjectui64v(queries[pass], GL_QUERY_RESULT, &elapsed_ns));
+      pass_ms[pass] = elapsed_ns * 1e-6f;
+   }
+
+   return true;
+}
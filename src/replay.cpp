@@ -0,0 +1,535 @@
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static u8
+input_to_bits(const Input &input)
+{
+   return (u8)(input.move_left << 0 |
+               input.move_right << 1 |
+               input.launch << 2 |
+               input.restart << 3 |
+               input.pause << 4);
+}
+
+static Input
+input_from_bits(u8 bits)
+{
+   Input input;
+   input.move_left = bits & (1 << 0);
+   input.move_right = bits & (1 << 1);
+   input.launch = bits & (1 << 2);
+   input.restart = bits & (1 << 3);
+   input.pause = bits & (1 << 4);
+
+   return input;
+}
+
+static u64
+hash_bytes(u64 hash, const void *data, size_t num_bytes)
+{
+   // FNV-1a.
+   const u8 *bytes = (const u8 *)data;
+   for (size_t i = 0; i < num_bytes; ++i)
+   {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ull;
+   }
+
+   return hash;
+}
+
+static u64
+hash_level_table(u64 hash, const Level_table *table)
+{
+   i32 num_cells = table->num_rows * table->num_cols;
+
+   hash = hash_bytes(hash, &table->num_rows, sizeof(table->num_rows));
+   hash = hash_bytes(hash, &table->num_cols, sizeof(table->num_cols));
+   hash = hash_bytes(hash, &table->num_blocks, sizeof(table->num_blocks));
+   hash = hash_bytes(hash, table->translations_x, table->num_blocks * sizeof(f32));
+   hash = hash_bytes(hash, table->translations_y, table->num_blocks * sizeof(f32));
+   hash = hash_bytes(hash, table->collectable_types, table->num_blocks * sizeof(Collectable_type));
+   hash = hash_bytes(hash, table->cell_blocks, num_cells * sizeof(i32));
+
+   return hash;
+}
+
+Replay_levels
+replay_levels_built_in()
+{
+   Replay_levels levels = {};
+   levels.source = REPLAY_LEVELS_BUILT_IN;
+   levels.hash = 0xcbf29ce484222325ull;
+   for (i32 level_index = 0; level_index < num_level_tables; ++level_index)
+      levels.hash = hash_level_table(levels.hash, &all_level_tables[level_index]);
+
+   return levels;
+}
+
+Replay_levels
+replay_levels_of_pack(const Level_pack *pack)
+{
+   Replay_levels levels = {};
+   levels.source = REPLAY_LEVELS_PACK;
+   levels.hash = hash_bytes(0xcbf29ce484222325ull, pack->memory, pack->memory_size);
+
+   return levels;
+}
+
+Replay_levels
+replay_levels_of_stress(i32 num_blocks)
+{
+   Replay_levels levels = {};
+   levels.source = REPLAY_LEVELS_STRESS;
+   levels.num_stress_blocks = (u32)num_blocks;
+
+   return levels;
+}
+
+Replay_levels
+replay_levels_of_generator(const Level_generator_params *params)
+{
+   Replay_levels levels = {};
+   levels.source = REPLAY_LEVELS_ENDLESS;
+   levels.hash = 0xcbf29ce484222325ull;
+   levels.hash = hash_bytes(levels.hash, &params->num_rows, sizeof(params->num_rows));
+   levels.hash = hash_bytes(levels.hash, &params->num_cols, sizeof(params->num_cols));
+   levels.hash = hash_bytes(levels.hash, &params->density, sizeof(params->density));
+   levels.hash = hash_bytes(levels.hash, &params->symmetry, sizeof(params->symmetry));
+   levels.hash = hash_bytes(levels.hash, params->type_weights, sizeof(params->type_weights));
+
+   return levels;
+}
+
+static const char *
+level_source_name(u32 source)
+{
+   switch (source)
+   {
+      case REPLAY_LEVELS_BUILT_IN: return "the built-in levels";
+      case REPLAY_LEVELS_PACK: return "a level pack";
+      case REPLAY_LEVELS_STRESS: return "a stress level";
+      case REPLAY_LEVELS_ENDLESS: return "endless levels";
+   }
+
+   return "unknown levels";
+}
+
+static void
+fill_probabilities(u16 *probabilities, size_t num_bytes)
+{
+   // Every bit starts out as likely to be 0 as 1.
+   for (size_t i = 0; i < num_bytes / sizeof(u16); ++i)
+      probabilities[i] = 1 << (REPLAY_PROBABILITY_BITS-1);
+}
+
+static void
+init_replay_model(Replay_model *model)
+{
+   fill_probabilities(&model->repeats[0][0], sizeof(model->repeats));
+   fill_probabilities(&model->buttons[0][0], sizeof(model->buttons));
+   fill_probabilities(&model->length_bits[0][0][0], sizeof(model->length_bits));
+   fill_probabilities(&model->length_mantissa[0][0], sizeof(model->length_mantissa));
+
+   model->prev_buttons[0] = 0;
+   model->prev_buttons[1] = 0;
+   model->prev_length_class = 0;
+}
+
+// Binary range coder with the usual 32 bit range and 5 bit adaptation steps,
+// a byte goes out whenever the top 8 bits of the range are settled.
+
+static void
+adapt(u16 *probability, u32 bit)
+{
+   if (bit) *probability -= *probability >> 5;
+   else *probability += ((1 << REPLAY_PROBABILITY_BITS) - *probability) >> 5;
+}
+
+static void
+shift_low(Range_encoder *encoder, Array<u8> *out)
+{
+   // Bytes that could still be bumped by a carry are held back in the cache.
+   if ((u32)encoder->low < 0xff000000u || (encoder->low >> 32))
+   {
+      u8 carry = (u8)(encoder->low >> 32);
+      u8 byte = encoder->cache;
+      do
+      {
+         array_add(out, (u8)(byte + carry));
+         byte = 0xff;
+      } while (--encoder->cache_size);
+
+      encoder->cache = (u8)(encoder->low >> 24);
+   }
+
+   ++encoder->cache_size;
+   encoder->low = (encoder->low & 0x00ffffff) << 8;
+}
+
+// The coders are used through the same code_* calls, so that recording and
+// playback walk the model identically. Coding returns the bit, which the
+// encoder is given and the decoder reads.
+struct Encoding
+{
+   Range_encoder *encoder;
+   Array<u8> *out;
+};
+
+struct Decoding
+{
+   Range_decoder *decoder;
+   const u8 *at;
+   const u8 *end;
+};
+
+static u32
+code_bit(Encoding *coding, u16 *probability, u32 bit)
+{
+   Range_encoder *encoder = coding->encoder;
+
+   u32 bound = (encoder->range >> REPLAY_PROBABILITY_BITS) * *probability;
+   if (bit)
+   {
+      encoder->low += bound;
+      encoder->range -= bound;
+   }
+   else
+      encoder->range = bound;
+   adapt(probability, bit);
+
+   while (encoder->range < (1u << 24))
+   {
+      encoder->range <<= 8;
+      shift_low(encoder, coding->out);
+   }
+
+   return bit;
+}
+
+static u32
+code_bit(Decoding *coding, u16 *probability, u32)
+{
+   Range_decoder *decoder = coding->decoder;
+
+   u32 bit;
+   u32 bound = (decoder->range >> REPLAY_PROBABILITY_BITS) * *probability;
+   if (decoder->code >= bound)
+   {
+      decoder->code -= bound;
+      decoder->range -= bound;
+      bit = 1;
+   }
+   else
+   {
+      decoder->range = bound;
+      bit = 0;
+   }
+   adapt(probability, bit);
+
+   while (decoder->range < (1u << 24))
+   {
+      // Past the end the coder reads zeros, like the ones it flushed.
+      u8 byte = coding->at < coding->end ? *coding->at++ : 0;
+      decoder->range <<= 8;
+      decoder->code = (decoder->code << 8) | byte;
+   }
+
+   return bit;
+}
+
+// Codes the low num_bits bits of value from the top one down, every bit with
+// the probability of the bits above it.
+template<typename Coding>
+static u32
+code_tree(Coding *coding, u16 *probabilities, i32 num_bits, u32 value)
+{
+   u32 node = 1;
+   for (i32 i = num_bits-1; i >= 0; --i)
+      node = 2*node + code_bit(coding, &probabilities[node], (value >> i) & 1);
+
+   return node - (1 << num_bits);
+}
+
+// The decoder passes in a run of length 1 and gets the decoded one back.
+template<typename Coding>
+static void
+code_run(Replay_model *model, Coding *coding, u8 *buttons, u64 *length)
+{
+   u8 prev = model->prev_buttons[0];
+   u8 before_prev = model->prev_buttons[1];
+
+   if (code_bit(coding, &model->repeats[prev][before_prev], *buttons == before_prev))
+      *buttons = before_prev;
+   else
+      *buttons = (u8)code_tree(coding, model->buttons[prev], REPLAY_INPUT_BITS, *buttons);
+
+   // log2 of REPLAY_LENGTH_BITS.
+   i32 num_bits_depth = 6;
+   i32 num_bits = 64 - __builtin_clzll(*length);
+   num_bits = 1 + code_tree(coding, model->length_bits[*buttons][model->prev_length_class], num_bits_depth, num_bits-1);
+
+   u64 value = 1;
+   for (i32 i = num_bits-2; i >= 0; --i)
+      value = 2*value + code_bit(coding, &model->length_mantissa[num_bits-1][i], (*length >> i) & 1);
+   *length = value;
+
+   model->prev_buttons[0] = *buttons;
+   model->prev_buttons[1] = prev;
+   model->prev_length_class = min(num_bits-1, REPLAY_LENGTH_CLASSES-1);
+}
+
+static void
+flush_run(Replay *replay)
+{
+   if (!replay->run_length)
+      return;
+
+   Encoding coding = {&replay->encoder, &replay->runs};
+   code_run(&replay->model, &coding, &replay->run_bits, &replay->run_length);
+
+   replay->run_length = 0;
+}
+
+void
+replay_begin(Replay *replay, u64 seed, const Replay_levels *levels)
+{
+   replay->seed = seed;
+   replay->levels = *levels;
+   replay->num_ticks = 0;
+   replay->final_checksum = 0;
+   replay->runs = array_create<u8>();
+   replay->run_bits = 0;
+   replay->run_length = 0;
+
+   init_replay_model(&replay->model);
+   replay->encoder.low = 0;
+   replay->encoder.range = 0xffffffffu;
+   replay->encoder.cache = 0;
+   replay->encoder.cache_size = 1;
+}
+
+void
+replay_record(Replay *replay, const Input &input)
+{
+   u8 bits = input_to_bits(input);
+   if (bits != replay->run_bits)
+   {
+      flush_run(replay);
+      replay->run_bits = bits;
+   }
+
+   ++replay->run_length;
+   ++replay->num_ticks;
+}
+
+void
+replay_end(Replay *replay, const Game_state *game_state)
+{
+   flush_run(replay);
+   // Pushes out the cached byte and all four of low.
+   for (i32 i = 0; i < 5; ++i)
+      shift_low(&replay->encoder, &replay->runs);
+
+   replay->final_checksum = game_state_checksum(game_state);
+}
+
+void
+replay_free(Replay *replay)
+{
+   array_free(replay->runs);
+   replay->runs = array_create<u8>();
+}
+
+bool
+replay_write(const Replay *replay, const char *path)
+{
+   FILE *file = fopen(path, "wb");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open replay file '%s' for writing.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   Replay_header header;
+   header.magic = REPLAY_MAGIC;
+   header.version = REPLAY_VERSION;
+   header.tick_rate = SIMULATION_TICK_RATE;
+   header.num_run_bytes = (u32)replay->runs.length;
+   header.seed = replay->seed;
+   header.num_ticks = replay->num_ticks;
+   header.final_checksum = replay->final_checksum;
+   header.levels = replay->levels;
+
+   if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+       fwrite(replay->runs.data, 1, replay->runs.length, file) != (size_t)replay->runs.length)
+   {
+      fprintf(stderr, "Failed to write replay file '%s'.\n", path);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+replay_read(Replay *replay, const char *path)
+{
+   FILE *file = fopen(path, "rb");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open replay file '%s'.\n", path);
+      return false;
+   }
+   defer { fclose(file); };
+
+   Replay_header header;
+   if (fread(&header, sizeof(header), 1, file) != 1 ||
+       header.magic != REPLAY_MAGIC)
+   {
+      fprintf(stderr, "'%s' is not a replay file.\n", path);
+      return false;
+   }
+   if (header.version != REPLAY_VERSION)
+   {
+      fprintf(stderr, "Replay '%s' has version %u, expected %u.\n", path, header.version, REPLAY_VERSION);
+      return false;
+   }
+   if (header.tick_rate != SIMULATION_TICK_RATE)
+   {
+      fprintf(stderr, "Replay '%s' was recorded at %u ticks/s, this build runs at %u.\n",
+            path, header.tick_rate, SIMULATION_TICK_RATE);
+      return false;
+   }
+
+   // The runs are the rest of the file, a corrupt count must not turn into a
+   // huge allocation.
+   long runs_begin = ftell(file);
+   fseek(file, 0, SEEK_END);
+   long file_size = ftell(file);
+   fseek(file, runs_begin, SEEK_SET);
+   if (header.num_run_bytes > (u64)(file_size - runs_begin))
+   {
+      fprintf(stderr, "Replay '%s' is truncated.\n", path);
+      return false;
+   }
+
+   replay->seed = header.seed;
+   replay->num_ticks = header.num_ticks;
+   replay->final_checksum = header.final_checksum;
+   replay->levels = header.levels;
+   replay->runs = array_create<u8>(header.num_run_bytes);
+   replay->run_bits = 0;
+   replay->run_length = 0;
+
+   if (fread(replay->runs.data, 1, header.num_run_bytes, file) != header.num_run_bytes)
+   {
+      fprintf(stderr, "Replay '%s' is truncated.\n", path);
+      replay_free(replay);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+replay_check_levels(const Replay *replay, const Replay_levels *levels, const char *path)
+{
+   const Replay_levels *recorded = &replay->levels;
+
+   if (recorded->source != levels->source)
+   {
+      fprintf(stderr, "Replay '%s' was recorded with %s, not %s.\n",
+            path, level_source_name(recorded->source), level_source_name(levels->source));
+      return false;
+   }
+   if (recorded->num_stress_blocks != levels->num_stress_blocks)
+   {
+      fprintf(stderr, "Replay '%s' was recorded with a stress level of %u blocks, not %u.\n",
+            path, recorded->num_stress_blocks, levels->num_stress_blocks);
+      return false;
+   }
+   if (recorded->hash != levels->hash)
+   {
+      switch (levels->source)
+      {
+         case REPLAY_LEVELS_PACK: fprintf(stderr, "Replay '%s' was recorded with another level pack.\n", path); break;
+         case REPLAY_LEVELS_ENDLESS: fprintf(stderr, "Replay '%s' was recorded with other endless level parameters.\n", path); break;
+         default: fprintf(stderr, "Replay '%s' was recorded with the built-in levels of another build.\n", path); break;
+      }
+      return false;
+   }
+
+   return true;
+}
+
+void
+replay_player_begin(Replay_player *player, const Replay *replay)
+{
+   player->replay = replay;
+   player->cursor = 0;
+   player->run_bits = 0;
+   player->run_ticks_left = 0;
+   player->tick = 0;
+
+   init_replay_model(&player->model);
+   player->decoder.code = 0;
+   player->decoder.range = 0xffffffffu;
+
+   // The first byte is the encoder's empty cache, always 0.
+   for (i32 i = 0; i < 5 && player->cursor < replay->runs.length; ++i)
+      player->decoder.code = (player->decoder.code << 8) | replay->runs.data[player->cursor++];
+}
+
+bool
+replay_next_input(Replay_player *player, Input *input)
+{
+   const Replay *replay = player->replay;
+   if (player->tick == replay->num_ticks)
+      return false;
+
+   if (!player->run_ticks_left)
+   {
+      Decoding coding = {&player->decoder, replay->runs.data + player->cursor, replay->runs.data + replay->runs.length};
+
+      u64 length = 1;
+      code_run(&player->model, &coding, &player->run_bits, &length);
+
+      player->cursor = (i32)(coding.at - replay->runs.data);
+      player->run_ticks_left = length;
+   }
+
+   *input = input_from_bits(player->run_bits);
+   --player->run_ticks_left;
+   ++player->tick;
+
+   return true;
+}
+
+bool
+replay_check_final_state(const Replay *replay, const Game_state *game_state)
+{
+   return game_state_checksum(game_state) == replay->final_checksum;
+}
+
+u64
+game_state_checksum(const Game_state *game_state)
+{
+   const Balls *balls = &game_state->balls;
+   const Level *level = game_state->level;
+
+   u64 hash = 0xcbf29ce484222325ull;
+   hash = hash_bytes(hash, &game_state->level_index, sizeof(game_state->level_index));
+   hash = hash_bytes(hash, &game_state->num_blocks_left, sizeof(game_state->num_blocks_left));
+   hash = hash_bytes(hash, &game_state->lives_left, sizeof(game_state->lives_left));
+   hash = hash_bytes(hash, &game_state->paddle.translate, sizeof(game_state->paddle.translate));
+   hash = hash_bytes(hash, &balls->num_balls, sizeof(balls->num_balls));
+   hash = hash_bytes(hash, balls->translations_x, balls->num_balls * sizeof(f32));
+   hash = hash_bytes(hash, balls->translations_y, balls->num_balls * sizeof(f32));
+   hash = hash_bytes(hash, level->block_cells, game_state->num_blocks_left * sizeof(i32));
+   hash = hash_bytes(hash, &game_state->random_series, sizeof(game_state->random_series));
+
+   return hash;
+}
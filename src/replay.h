@@ -0,0 +1,164 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "game.h"
+#include "level_pack.h"
+#include "level_generator.h"
+
+// A replay is the seed of a game plus the Input of every game_update call.
+// Simulation is deterministic, so feeding the inputs back into a game
+// initialized with the same seed reproduces the session exactly.
+//
+// Inputs are stored as runs of identical ticks, each run its buttons and its
+// length, range coded bit by bit with probabilities that adapt as the replay
+// goes, see Replay_model. The buttons are predicted from the two runs before,
+// since keys tend to alternate, and the length from the buttons and the length
+// of the run before. While the game is paused only the ticks on which the
+// pause key changes are recorded, so a pause takes the same two ticks however
+// long it lasts. The bot's 3M tick (3.5 hour) sessions take 6-7 KB, an hour
+// of the jittery bot on endless levels under 60 KB.
+//
+// Levels are not stored, only where they came from. Playing a replay with
+// other levels than it was recorded with is refused before the first tick.
+
+#define REPLAY_MAGIC 0x524b5241 // "ARKR"
+#define REPLAY_VERSION 3
+
+#define REPLAY_INPUT_BITS 5
+#define REPLAY_NUM_BUTTONS (1 << REPLAY_INPUT_BITS)
+// Run lengths are coded as their number of significant bits, then the bits
+// below the top one. REPLAY_LENGTH_CLASSES is how many of the counts are told
+// apart when predicting the next run, the rest count as the last one.
+#define REPLAY_LENGTH_BITS 64
+#define REPLAY_LENGTH_CLASSES 8
+#define REPLAY_PROBABILITY_BITS 11
+
+enum Replay_level_source
+{
+   REPLAY_LEVELS_BUILT_IN = 0,
+   REPLAY_LEVELS_PACK,
+   REPLAY_LEVELS_STRESS,
+   REPLAY_LEVELS_ENDLESS,
+};
+
+struct Replay_levels
+{
+   u32 source; // Replay_level_source.
+   // Blocks asked for of the stress level, 0 for the other sources.
+   u32 num_stress_blocks;
+   // Built-in levels and packs hash their level data, endless ones the
+   // generator parameters. Generated levels also depend on the seed.
+   u64 hash;
+};
+
+struct Replay_header
+{
+   u32 magic;
+   u32 version;
+   u32 tick_rate;
+   u32 num_run_bytes;
+   u64 seed;
+   u64 num_ticks;
+   // game_state_checksum after the last tick, to detect desyncs on playback.
+   u64 final_checksum;
+   Replay_levels levels;
+};
+
+// Probabilities of a bit being 0, out of 1 << REPLAY_PROBABILITY_BITS, by
+// what is known when it is coded. Recording and playback update them the same
+// way, so they stay in step.
+struct Replay_model
+{
+   // Whether a run has the buttons of the one before the previous one, by the
+   // buttons of the previous two runs.
+   u16 repeats[REPLAY_NUM_BUTTONS][REPLAY_NUM_BUTTONS];
+   // Otherwise the buttons, as a binary tree, by the previous run's buttons.
+   u16 buttons[REPLAY_NUM_BUTTONS][REPLAY_NUM_BUTTONS];
+   // Significant bits of the length minus one, as a binary tree, by the run's
+   // buttons and the length class of the previous run.
+   u16 length_bits[REPLAY_NUM_BUTTONS][REPLAY_LENGTH_CLASSES][REPLAY_LENGTH_BITS];
+   // Bits below the top one, by the number of significant bits and position.
+   u16 length_mantissa[REPLAY_LENGTH_BITS][REPLAY_LENGTH_BITS];
+
+   u8 prev_buttons[2];
+   i32 prev_length_class;
+};
+
+struct Range_encoder
+{
+   u64 low;
+   u32 range;
+   u8 cache;
+   u64 cache_size;
+};
+
+struct Range_decoder
+{
+   u32 code;
+   u32 range;
+};
+
+struct Replay
+{
+   u64 seed;
+   Replay_levels levels;
+   u64 num_ticks;
+   u64 final_checksum;
+   // Range coded runs.
+   Array<u8> runs;
+
+   // Run that is still being recorded.
+   u8 run_bits;
+   u64 run_length;
+   Replay_model model;
+   Range_encoder encoder;
+};
+
+struct Replay_player
+{
+   const Replay *replay;
+   i32 cursor;
+   u8 run_bits;
+   u64 run_ticks_left;
+   u64 tick;
+   Replay_model model;
+   Range_decoder decoder;
+};
+
+Replay_levels
+replay_levels_built_in();
+Replay_levels
+replay_levels_of_pack(const Level_pack *pack);
+Replay_levels
+replay_levels_of_stress(i32 num_blocks);
+Replay_levels
+replay_levels_of_generator(const Level_generator_params *params);
+
+void
+replay_begin(Replay *replay, u64 seed, const Replay_levels *levels);
+void
+replay_record(Replay *replay, const Input &input);
+void
+replay_end(Replay *replay, const Game_state *game_state);
+void
+replay_free(Replay *replay);
+
+bool
+replay_write(const Replay *replay, const char *path);
+bool
+replay_read(Replay *replay, const char *path);
+// Reports it when the replay was recorded with other levels.
+bool
+replay_check_levels(const Replay *replay, const Replay_levels *levels, const char *path);
+
+void
+replay_player_begin(Replay_player *player, const Replay *replay);
+bool
+replay_next_input(Replay_player *player, Input *input);
+bool
+replay_check_final_state(const Replay *replay, const Game_state *game_state);
+
+u64
+game_state_checksum(const Game_state *game_state);
+
+#endif
@@ -1,6 +1,23 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+
 namespace Graphics
 {
 
+#define PROGRAM_BINARY_MAGIC 0x42505241u // "ARPB"
+
+// Precedes the binary in a cache file.
+struct Program_binary_header
+{
+   u32 magic;
+   GLenum format;
+   u64 key;
+   u32 length;
+   u32 unused;
+};
+
 static GLuint
 compile_shader(const char *shader_code, GLenum shader_type)
 {
@@ -45,13 +62,21 @@ read_file(FILE *file)
    return contents;
 }
 
-GLuint
-compile_shaders(const char *vertex_code, const char *fragment_code)
+// Retrievable programs can be saved with glGetProgramBinary.
+static GLuint
+link_program(const char *vertex_code, const char *fragment_code, bool retrievable)
 {
+   PROFILE_ZONE("compile_shaders");
+
    GL_CALL(GLuint program_id = glCreateProgram());
    if (!program_id)
       return 0;
 
+   if (retrievable)
+   {
+      GL_CALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+   }
+
    GLuint vertex_id = compile_shader(vertex_code, GL_VERTEX_SHADER);
    if (!vertex_id)
       return 0;
@@ -82,6 +107,12 @@ compile_shaders(const char *vertex_code, const char *fragment_code)
    return program_id;
 }
 
+GLuint
+compile_shaders(const char *vertex_code, const char *fragment_code)
+{
+   return link_program(vertex_code, fragment_code, false);
+}
+
 GLuint
 load_shaders(const char *vertex_shader_path, const char *fragment_shader_path)
 {
@@ -106,4 +137,187 @@ load_shaders(const char *vertex_shader_path, const char *fragment_shader_path)
    return compile_shaders(vertex_code, fragment_code);
 }
 
+// FNV-1a, continuing from hash.
+static u64
+hash_string(u64 hash, const char *string)
+{
+   for (const char *c = string; *c; ++c)
+   {
+      hash ^= (u8)*c;
+      hash *= 0x100000001b3ull;
+   }
+
+   // The terminator too, so that "ab" "c" and "a" "bc" differ.
+   hash *= 0x100000001b3ull;
+   return hash;
+}
+
+void
+program_cache_init(Program_cache *cache, const char *directory)
+{
+   cache->directory = 0;
+   cache->driver_hash = 0;
+   cache->num_loaded = 0;
+   cache->num_compiled = 0;
+
+   if (!directory || !GLEW_ARB_get_program_binary)
+      return;
+
+   GLint num_formats;
+   GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats));
+   if (num_formats <= 0)
+      return;
+
+   if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+   {
+      fprintf(stderr, "Cannot create the shader cache directory '%s', shaders are compiled.\n", directory);
+      return;
+   }
+
+   const char *driver_strings[] = {
+      (const char *)glGetString(GL_VENDOR),
+      (const char *)glGetString(GL_RENDERER),
+      (const char *)glGetString(GL_VERSION),
+   };
+
+   u64 hash = 0xcbf29ce484222325ull;
+   for (const char *string : driver_strings)
+      hash = hash_string(hash, string ? string : "");
+
+   cache->directory = directory;
+   cache->driver_hash = hash;
+}
+
+static void
+program_cache_path(Program_cache *cache, u64 key, char *path, size_t path_size)
+{
+   snprintf(path, path_size, "%s/%016llx.bin", cache->directory, (unsigned long long)key);
+}
+
+static GLuint
+load_program_binary(Program_cache *cache, u64 key)
+{
+   PROFILE_ZONE("load_program_binary");
+
+   char path[1024];
+   program_cache_path(cache, key, path, sizeof(path));
+
+   FILE *file = fopen(path, "rb");
+   if (!file)
+      return 0;
+
+   defer { fclose(file); };
+
+   fseek(file, 0, SEEK_END);
+   long file_size = ftell(file);
+   rewind(file);
+
+   // A truncated or damaged file is a miss, not a huge allocation.
+   Program_binary_header header;
+   if (fread(&header, sizeof(header), 1, file) != 1 ||
+       header.magic != PROGRAM_BINARY_MAGIC ||
+       header.key != key ||
+       header.length == 0 ||
+       header.length > file_size - (long)sizeof(header))
+      return 0;
+
+   void *binary = malloc(header.length);
+   defer { free(binary); };
+
+   if (fread(binary, header.length, 1, file) != 1)
+      return 0;
+
+   GL_CALL(GLuint program_id = glCreateProgram());
+   if (!program_id)
+      return 0;
+
+   // Drivers reject binaries of other versions or hardware here, the key
+   // should have caught those already. A format the driver doesn't support
+   // raises GL_INVALID_ENUM instead, which is cleared here, the program is
+   // left unlinked and the cache misses all the same.
+   glProgramBinary(program_id, header.format, binary, header.length);
+   while (glGetError() != GL_NO_ERROR);
+
+   GLint link_status;
+   GL_CALL(glGetProgramiv(program_id, GL_LINK_STATUS, &link_status));
+   if (link_status == GL_FALSE)
+   {
+      GL_CALL(glDeleteProgram(program_id));
+      return 0;
+   }
+
+   return program_id;
+}
+
+static void
+save_program_binary(Program_cache *cache, u64 key, GLuint program_id)
+{
+   PROFILE_ZONE("save_program_binary");
+
+   GLint length;
+   GL_CALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+   if (length <= 0)
+      return;
+
+   Program_binary_header header;
+   header.magic = PROGRAM_BINARY_MAGIC;
+   header.key = key;
+   header.length = length;
+   header.unused = 0;
+
+   void *binary = malloc(length);
+   defer { free(binary); };
+
+   GL_CALL(glGetProgramBinary(program_id, length, 0, &header.format, binary));
+
+   // Written next to the file and renamed over it, so that a launch that
+   // dies halfway never leaves a torn binary behind.
+   char path[1024];
+   char temp_path[1040];
+   program_cache_path(cache, key, path, sizeof(path));
+   snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+   FILE *file = fopen(temp_path, "wb");
+   if (!file)
+      return;
+
+   bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(binary, length, 1, file) == 1;
+   written = fclose(file) == 0 && written;
+
+   if (!written || rename(temp_path, path) != 0)
+   {
+      fprintf(stderr, "Failed to save a shader binary to '%s'.\n", path);
+      remove(temp_path);
+   }
+}
+
+GLuint
+compile_shaders(Program_cache *cache, const char *vertex_code, const char *fragment_code)
+{
+   if (!cache->directory)
+   {
+      ++cache->num_compiled;
+      return compile_shaders(vertex_code, fragment_code);
+   }
+
+   u64 key = hash_string(hash_string(cache->driver_hash, vertex_code), fragment_code);
+
+   GLuint program_id = load_program_binary(cache, key);
+   if (program_id)
+   {
+      ++cache->num_loaded;
+      return program_id;
+   }
+
+   program_id = link_program(vertex_code, fragment_code, true);
+   if (!program_id)
+      return 0;
+
+   ++cache->num_compiled;
+   save_program_binary(cache, key, program_id);
+
+   return program_id;
+}
+
 } // namespace Graphics
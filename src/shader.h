@@ -4,11 +4,34 @@
 namespace Graphics
 {
 
+// Linked programs saved with glGetProgramBinary, so that later launches skip
+// compiling and linking. Every program is a file in the directory, named by a
+// hash of its sources and of the driver's vendor, renderer and version
+// strings, so a driver update or a shader change just misses. Binaries the
+// driver rejects anyway are compiled from source and saved again.
+struct Program_cache
+{
+   // 0 when the driver cannot give out program binaries, everything is
+   // compiled then.
+   const char *directory;
+   u64 driver_hash;
+
+   i32 num_loaded;
+   i32 num_compiled;
+};
+
 GLuint
 compile_shaders(const char *vertex_code, const char *fragment_code);
 GLuint
 load_shaders(const char *vertex_file_path, const char *fragment_file_path);
 
+// Creates the directory if it does not exist yet.
+void
+program_cache_init(Program_cache *cache, const char *directory);
+// compile_shaders, through the cache.
+GLuint
+compile_shaders(Program_cache *cache, const char *vertex_code, const char *fragment_code);
+
 }
 
 #endif
@@ -15,27 +15,14 @@ void main()
 }
 )FOO";
 
-const char *background_fragment_code = R"FOO(
+// One tile of the background pattern, rendered once into a texture that the
+// background repeats across the window. Colors are stored doubled, which keeps
+// them exact in 8 bits and is what the pulse multiplies them by anyway.
+const char *background_tile_fragment_code = R"FOO(
 #version 330 core
 
-in float v_normalized_position_x;
-
 out vec4 f_color;
 
-uniform float time;
-
-float
-constrain(float value,
-   float value_min,
-   float value_max,
-   float target_min,
-   float target_max)
-{
-   float value_frac = (value - value_min) / (value_max - value_min);
-   float target_span = target_max - target_min;
-   return target_min + value_frac * target_span;
-}
-
 void main()
 {
    int a = 50;
@@ -57,103 +44,115 @@ void main()
          f_color = vec4(50.5f/255, 15.0f/255, 31.0f/255, 1.0f);
    }
 
-   float k = abs(cos(time)) * (1.0f - abs(v_normalized_position_x));
-   k = constrain(k, 0.0f, 1.0f, 0.6f, 1.0f);
-   f_color.rgb *= 2.0f * k;
+   f_color.rgb *= 2.0f;
 }
 )FOO";
 
-const char *paddle_vertex_code = R"FOO(
+const char *background_fragment_code = R"FOO(
 #version 330 core
 
-layout(location = 0) in vec2 i_position;
+in float v_normalized_position_x;
 
-out vec2 v_position;
+out vec4 f_color;
 
-uniform vec2 scale;
-uniform vec2 translate;
+uniform sampler2D tile;
+// abs(cos(time)), the same for every pixel.
+uniform float pulse;
 
 void main()
 {
-   gl_Position = vec4(scale * i_position + translate, 0.0f, 1.0f);
-   v_position = i_position;
-}
-)FOO";
+   // Window pixel centers land on texel centers of the repeating tile.
+   vec3 color = texture(tile, gl_FragCoord.xy / vec2(textureSize(tile, 0))).rgb;
 
-const char *paddle_fragment_code = R"FOO(
-#version 330 core
-
-in vec2 v_position;
-
-out vec4 f_color;
-
-void main()
-{
-   f_color = vec4(80.0f/255, 120.0f/255, 111.0f/255, 1.0f);
+   // Brightest in the middle, from 0.6 at the edges up to 1.0.
+   float k = 0.6f + 0.4f * pulse * (1.0f - abs(v_normalized_position_x));
+   f_color = vec4(k * color, 1.0f);
 }
 )FOO";
 
-const char *ball_vertex_code = R"FOO(
+// Paddle, blocks, collectables and balls, all in one instanced draw call.
+// Instances are pulled from buffer textures by gl_InstanceID: the level's
+// blocks come first, from the level's sprites, the rest from this frame's
+// region of the streaming buffer. A sprite is two texels, its center and half
+// size, then its color and Sprite_shape. Destroyed blocks are culled here, by
+// their cell's alive bit.
+const char *sprite_vertex_code = R"FOO(
 #version 330 core
 
 layout(location = 0) in vec2 i_position;
 
 out vec2 v_position;
-
-uniform float radius;
-uniform vec2 translate;
+out vec3 v_color;
+flat out int v_shape;
+
+// Read as integers, so that the cells the blocks keep in place of their shape
+// come through bit for bit.
+uniform usamplerBuffer level_sprites;
+// Level's alive cells, 32 per texel.
+uniform usamplerBuffer alive_cells;
+uniform samplerBuffer frame_sprites;
+uniform int num_level_sprites;
+// Texel of this frame's first sprite.
+uniform int frame_sprites_base;
 
 void main()
 {
-   gl_Position = vec4(radius * i_position + translate, 0.0f, 1.0f);
-   v_position = i_position;
-}
-)FOO";
+   vec4 placement;
+   vec3 color;
+   int shape;
+   bool alive = true;
 
-const char *ball_fragment_code = R"FOO(
-#version 330 core
-in vec2 v_position;
-
-out vec4 f_color;
-
-void main()
-{
-   if (dot(v_position, v_position) <= 1.0f)
-      f_color = vec4(244.0f/255, 192.0f/255, 149.0f/255, 1.0f);
+   if (gl_InstanceID < num_level_sprites)
+   {
+      uvec4 level_placement = texelFetch(level_sprites, 2*gl_InstanceID);
+      uvec4 level_material = texelFetch(level_sprites, 2*gl_InstanceID + 1);
+      placement = uintBitsToFloat(level_placement);
+      color = uintBitsToFloat(level_material.rgb);
+      shape = 0;
+
+      uint cell = level_material.a;
+      uint alive_word = texelFetch(alive_cells, int(cell / 32u)).r;
+      alive = ((alive_word >> (cell % 32u)) & 1u) != 0u;
+   }
    else
-      f_color = vec4(0.0f);
-}
-)FOO";
-
-const char *block_vertex_code = R"FOO(
-#version 330 core
-
-layout(location = 0) in vec2 i_position;
-layout(location = 1) in vec2 i_translate;
-layout(location = 2) in vec3 i_color;
-
-out vec3 v_color;
-
-uniform vec2 scale;
+   {
+      int texel = frame_sprites_base + 2*(gl_InstanceID - num_level_sprites);
+      vec4 material = texelFetch(frame_sprites, texel + 1);
+      placement = texelFetch(frame_sprites, texel);
+      color = material.rgb;
+      shape = int(material.a);
+   }
 
-void main()
-{
-   gl_Position = vec4(scale * i_position + i_translate, 0.0f, 1.0f);
-   v_color = i_color;
+   // Destroyed blocks collapse into a point outside of the clip volume.
+   if (alive)
+      gl_Position = vec4(placement.zw * i_position + placement.xy, 0.0f, 1.0f);
+   else
+      gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+   v_position = i_position;
+   v_color = color;
+   v_shape = shape;
 }
 )FOO";
 
-const char *block_fragment_code = R"FOO(
+const char *sprite_fragment_code = R"FOO(
 #version 330 core
 
+in vec2 v_position;
 in vec3 v_color;
+flat in int v_shape;
 
 out vec4 f_color;
 
+// Sprite_shape.
+const int SHAPE_DISC = 1;
+
 void main()
 {
-   //f_color = vec4(244.0f/255, 192.0f/255, 149.0f/255, 1.0f);
-   f_color = vec4(v_color, 1.0f);
+   // Discs are drawn on their bounding square, the corners are blended away.
+   if (v_shape == SHAPE_DISC && dot(v_position, v_position) > 1.0f)
+      f_color = vec4(0.0f);
+   else
+      f_color = vec4(v_color, 1.0f);
 }
 )FOO";
 
@@ -0,0 +1,130 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Kernels over the SoA block positions of a Level. The AVX2 version is picked
+// at runtime when the CPU supports it, SSE2 is the x86-64 baseline.
+
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARKANOID_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef ARKANOID_X86
+
+__attribute__((target("avx2")))
+static u32
+blocks_in_box_mask_avx2(Level *level, i32 first_block, v2 min_corner, v2 max_corner)
+{
+   __m256 x = _mm256_load_ps(level->translations_x + first_block);
+   __m256 y = _mm256_load_ps(level->translations_y + first_block);
+
+   __m256 inside_x = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(min_corner.x), _CMP_GE_OQ),
+                                   _mm256_cmp_ps(x, _mm256_set1_ps(max_corner.x), _CMP_LE_OQ));
+   __m256 inside_y = _mm256_and_ps(_mm256_cmp_ps(y, _mm256_set1_ps(min_corner.y), _CMP_GE_OQ),
+                                   _mm256_cmp_ps(y, _mm256_set1_ps(max_corner.y), _CMP_LE_OQ));
+
+   return (u32)_mm256_movemask_ps(_mm256_and_ps(inside_x, inside_y));
+}
+
+static u32
+blocks_in_box_mask_sse2(Level *level, i32 first_block, v2 min_corner, v2 max_corner)
+{
+   __m128 min_x = _mm_set1_ps(min_corner.x);
+   __m128 max_x = _mm_set1_ps(max_corner.x);
+   __m128 min_y = _mm_set1_ps(min_corner.y);
+   __m128 max_y = _mm_set1_ps(max_corner.y);
+
+   u32 mask = 0;
+   for (i32 half = 0; half < BLOCK_LANES/4; ++half)
+   {
+      __m128 x = _mm_load_ps(level->translations_x + first_block + 4*half);
+      __m128 y = _mm_load_ps(level->translations_y + first_block + 4*half);
+
+      __m128 inside_x = _mm_and_ps(_mm_cmpge_ps(x, min_x), _mm_cmple_ps(x, max_x));
+      __m128 inside_y = _mm_and_ps(_mm_cmpge_ps(y, min_y), _mm_cmple_ps(y, max_y));
+
+      mask |= (u32)_mm_movemask_ps(_mm_and_ps(inside_x, inside_y)) << (4*half);
+   }
+
+   return mask;
+}
+
+#endif
+
+// Reference for the other two, and the kernel where there is no SSE.
+static u32
+blocks_in_box_mask_scalar(Level *level, i32 first_block, v2 min_corner, v2 max_corner)
+{
+   u32 mask = 0;
+   for (i32 lane = 0; lane < BLOCK_LANES; ++lane)
+   {
+      f32 x = level->translations_x[first_block + lane];
+      f32 y = level->translations_y[first_block + lane];
+
+      if (x >= min_corner.x && x <= max_corner.x && y >= min_corner.y && y <= max_corner.y)
+         mask |= 1u << lane;
+   }
+
+   return mask;
+}
+
+// Bit i of the result is set iff the center of block first_block+i lies inside
+// the box. first_block has to be a multiple of BLOCK_LANES. Lanes past
+// num_blocks hold BLOCK_PADDING_POSITION and never match, lanes of destroyed
+// blocks have to be masked out by the caller.
+inline u32
+blocks_in_box_mask(Level *level, i32 first_block, v2 min_corner, v2 max_corner)
+{
+   assert(first_block % BLOCK_LANES == 0);
+
+#ifdef ARKANOID_X86
+   static const bool has_avx2 = __builtin_cpu_supports("avx2");
+   u32 mask = has_avx2 ?
+      blocks_in_box_mask_avx2(level, first_block, min_corner, max_corner) :
+      blocks_in_box_mask_sse2(level, first_block, min_corner, max_corner);
+#else
+   u32 mask = blocks_in_box_mask_scalar(level, first_block, min_corner, max_corner);
+#endif
+
+#ifdef ARKANOID_SLOW
+   assert(mask == blocks_in_box_mask_scalar(level, first_block, min_corner, max_corner));
+#endif
+
+   return mask;
+}
+
+// Runs every kernel this CPU has over all of the level's blocks, padding
+// included, and reports the first lane group where one disagrees with the
+// scalar kernel.
+inline bool
+block_kernels_agree(Level *level, v2 min_corner, v2 max_corner)
+{
+   for (i32 first = 0; first < level->num_padded_blocks; first += BLOCK_LANES)
+   {
+      u32 expected = blocks_in_box_mask_scalar(level, first, min_corner, max_corner);
+
+      u32 masks[2] = { expected, expected };
+      const char *names[2] = { "SSE2", "AVX2" };
+#ifdef ARKANOID_X86
+      masks[0] = blocks_in_box_mask_sse2(level, first, min_corner, max_corner);
+      if (__builtin_cpu_supports("avx2"))
+         masks[1] = blocks_in_box_mask_avx2(level, first, min_corner, max_corner);
+#endif
+
+      for (i32 i = 0; i < 2; ++i)
+      {
+         if (masks[i] != expected)
+         {
+            fprintf(stderr, "%s block kernel returned %08x instead of %08x for blocks %d..%d.\n",
+                  names[i], masks[i], expected, first, first + BLOCK_LANES-1);
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+namespace Graphics
+{
+
+bool
+create_stream_buffer(Stream_buffer *stream, GLsizeiptr frame_size)
+{
+   stream->frame_size = (frame_size + STREAM_BUFFER_ALIGNMENT-1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+   stream->persistent = GLEW_ARB_buffer_storage;
+   stream->frame = 0;
+   stream->frame_used = 0;
+   stream->frame_written = 0;
+   stream->num_waits = 0;
+   for (i32 frame = 0; frame < STREAM_BUFFER_FRAMES; ++frame)
+      stream->fences[frame] = 0;
+
+   GL_CALL(glGenBuffers(1, &stream->buffer));
+   GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, stream->buffer));
+
+   if (stream->persistent)
+   {
+      // Coherent, so that writes need no explicit flush before the draws.
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      GLsizeiptr ring_size = STREAM_BUFFER_FRAMES * stream->frame_size;
+
+      GL_CALL(glBufferStorage(GL_ARRAY_BUFFER, ring_size, 0, flags));
+      GL_CALL(stream->memory = (u8 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, ring_size, flags));
+      if (!stream->memory)
+      {
+         fprintf(stderr, "Failed to map the streaming buffer.\n");
+         return false;
+      }
+   }
+   else
+   {
+      GL_CALL(glBufferData(GL_ARRAY_BUFFER, stream->frame_size, 0, GL_STREAM_DRAW));
+      stream->memory = (u8 *)malloc(stream->frame_size);
+   }
+
+   return true;
+}
+
+void
+stream_buffer_begin_frame(Stream_buffer *stream)
+{
+   stream->frame_used = 0;
+   stream->frame_written = 0;
+
+   GLsync fence = stream->fences[stream->frame];
+   if (!fence)
+      return;
+
+   // The GPU is normally done with a region long before it comes around again,
+   // this only waits when it is STREAM_BUFFER_FRAMES frames behind.
+   GLenum result;
+   GL_CALL(result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0));
+   if (result == GL_TIMEOUT_EXPIRED)
+   {
+      ++stream->num_waits;
+      while (result == GL_TIMEOUT_EXPIRED)
+      {
+         GL_CALL(result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000));
+      }
+   }
+
+   GL_CALL(glDeleteSync(fence));
+   stream->fences[stream->frame] = 0;
+}
+
+void *
+stream_buffer_allocate(Stream_buffer *stream, GLsizeiptr size, GLintptr *offset)
+{
+   assert(stream->frame_used + size <= stream->frame_size);
+
+   GLintptr frame_offset = stream->persistent ? stream->frame * stream->frame_size : 0;
+   *offset = frame_offset + stream->frame_used;
+   stream->frame_used += (size + STREAM_BUFFER_ALIGNMENT-1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+   stream->frame_written += size;
+
+   return stream->memory + *offset;
+}
+
+GLsizeiptr
+stream_buffer_end_writes(Stream_buffer *stream)
+{
+   if (!stream->persistent)
+   {
+      GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, stream->buffer));
+      GL_CALL(glBufferData(GL_ARRAY_BUFFER, stream->frame_size, 0, GL_STREAM_DRAW));
+      GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, stream->frame_used, stream->memory));
+   }
+
+   return stream->frame_written;
+}
+
+void
+stream_buffer_end_frame(Stream_buffer *stream)
+{
+   if (!stream->persistent)
+      return;
+
+   GL_CALL(stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+   stream->frame = (stream->frame + 1) % STREAM_BUFFER_FRAMES;
+}
+
+}
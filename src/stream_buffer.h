@@ -0,0 +1,57 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+// Regions of the ring, the GPU may still be reading the previous two while the
+// CPU writes the third.
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_ALIGNMENT 16
+
+namespace Graphics
+{
+
+// Vertex data the CPU writes every frame and the GPU reads once. Where
+// ARB_buffer_storage is available it is a persistently mapped ring of
+// STREAM_BUFFER_FRAMES regions, a frame writes straight into its own region
+// and a fence per region guards its reuse. Elsewhere a frame is written into a
+// CPU copy and uploaded into a freshly orphaned buffer, which the driver hands
+// out without waiting for the GPU to finish with the old one. Either way
+// nothing that is written ever synchronizes with draws in flight.
+struct Stream_buffer
+{
+   GLuint buffer;
+   GLsizeiptr frame_size;
+   bool persistent;
+
+   // The mapped ring, or the CPU copy of the frame.
+   u8 *memory;
+   i32 frame;
+   // Allocated so far this frame, with the alignment between allocations, and
+   // what was asked for, without it.
+   GLsizeiptr frame_used;
+   GLsizeiptr frame_written;
+   GLsync fences[STREAM_BUFFER_FRAMES];
+
+   // Frames that found the GPU still reading their region.
+   i64 num_waits;
+};
+
+bool
+create_stream_buffer(Stream_buffer *stream, GLsizeiptr frame_size);
+
+void
+stream_buffer_begin_frame(Stream_buffer *stream);
+// Room for size bytes of this frame, offset is where they are in the buffer,
+// for the attribute pointers.
+void *
+stream_buffer_allocate(Stream_buffer *stream, GLsizeiptr size, GLintptr *offset);
+// Hands the writes of this frame to the GL, returns how many bytes they were,
+// not counting the alignment padding between them.
+GLsizeiptr
+stream_buffer_end_writes(Stream_buffer *stream);
+// After the last draw call that reads this frame's data.
+void
+stream_buffer_end_frame(Stream_buffer *stream);
+
+}
+
+#endif